@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+// Number of heap allocations made by the calling thread so far. Counted are
+// all allocations through operator new and all cv::Mat buffers once a
+// CountingMatAllocator is installed; the middleware threads do not disturb
+// the count of the processing thread.
+inline uint64_t &allocationCount() noexcept
+{
+    static thread_local uint64_t count{0};
+    return count;
+}
+
+// Forwards to OpenCV's standard allocator and counts every cv::Mat buffer.
+class CountingMatAllocator : public cv::MatAllocator
+{
+  public:
+    CountingMatAllocator()
+        : m_allocator(cv::Mat::getStdAllocator())
+    {
+    }
+
+    CountingMatAllocator(const CountingMatAllocator &) = delete;
+    CountingMatAllocator &operator=(const CountingMatAllocator &) = delete;
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, int flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        if (nullptr == data)
+        {
+            allocationCount()++;
+        }
+        return m_allocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return m_allocator->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override
+    {
+        m_allocator->deallocate(data);
+    }
+
+  private:
+    cv::MatAllocator *m_allocator;
+};
+
+// Checks that every frame after the first is processed without touching the
+// heap. The first frame that allocates is reported once; report() gives the
+// total of all frames after the first.
+class SteadyStateAllocations
+{
+  public:
+    void begin() noexcept
+    {
+        m_before = allocationCount();
+    }
+
+    // Returns false for a frame after the first that allocated.
+    bool end(std::ostream &out)
+    {
+        const uint64_t allocations{allocationCount() - m_before};
+        if (0 == m_frames++)
+        {
+            return true;
+        }
+        if ((0 < allocations) && (0 == m_allocations))
+        {
+            out << "allocations: " << allocations << " heap allocations in frame " << m_frames << "; frames after the first must not touch the heap" << std::endl;
+        }
+        m_allocations += allocations;
+        return 0 == allocations;
+    }
+
+    uint64_t allocations() const noexcept
+    {
+        return m_allocations;
+    }
+
+    void report(std::ostream &out) const
+    {
+        out << "allocations: " << m_allocations << " heap allocations in " << ((0 < m_frames) ? m_frames - 1 : 0) << " frames after the first" << std::endl;
+    }
+
+  private:
+    uint64_t m_before{0};
+    uint64_t m_frames{0};
+    uint64_t m_allocations{0};
+};
+
+// The replacements of the global allocation functions have to be defined in
+// exactly one translation unit of an executable.
+#ifdef ALLOCATION_COUNTER_IMPLEMENTATION
+void *operator new(std::size_t size)
+{
+    allocationCount()++;
+    if (void *ptr = std::malloc(0 == size ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    allocationCount()++;
+    return std::malloc(0 == size ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Offline benchmark of the cone pipeline: runs the detection and steering code of
+// template-opencv over decoded frames as fast as possible, without an OD4Session or
+// shared memory, and reports the frame rate, the stage latencies and the accuracy
+// against the ground steering requests of a recording.
+
+// libcluon is only used to parse the command line and to read the recording
+#include "cluon-complete.hpp"
+#include "cluon-complete-v0.0.127.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include "cone-colour-classifier.hpp"
+#include "cone-pipeline.hpp"
+#include "frame-workspace.hpp"
+#include "latency-histogram.hpp"
+#include "raw-frame-file.hpp"
+#include "result-writer.hpp"
+#include "steering-history.hpp"
+#include "worker-pool.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A decoded frame in the layout of the shared memory and its sample time stamp; frames of a
+// raw frame file point into its mapping.
+struct BenchFrame
+{
+    int64_t sampleTimeStamp;
+    cv::Mat bgra;
+};
+
+// Sample time stamp in microseconds from a file name like 1612345678123456.png; -1 if there is none.
+int64_t timeStampOfFile(const std::string &path){
+
+                const std::size_t slash = path.find_last_of("/\\");
+                const std::string file = path.substr((std::string::npos == slash) ? 0 : slash + 1);
+                const std::string stem = file.substr(0, file.find('.'));
+                if (stem.empty() || (std::string::npos != stem.find_first_not_of("0123456789")))
+                {
+                    return -1;
+                }
+                return std::stoll(stem);
+
+}
+
+
+// All ground steering requests of a recording as (sample time stamp, groundSteering), sorted by time.
+std::vector<std::pair<int64_t, double>> readGroundTruth(const std::string &recording){
+
+                std::vector<std::pair<int64_t, double>> groundTruth;
+                cluon::Player player{recording, false, false};
+                while (player.hasMoreData())
+                {
+                    auto next = player.getNextEnvelopeToBeReplayed();
+                    if (next.first && (opendlv::proxy::GroundSteeringRequest::ID() == next.second.dataType()))
+                    {
+                        const int64_t sampleTimeStamp{cluon::time::toMicroseconds(next.second.sampleTimeStamp())};
+                        const auto gsr = cluon::extractMessage<opendlv::proxy::GroundSteeringRequest>(std::move(next.second));
+                        groundTruth.emplace_back(sampleTimeStamp, static_cast<double>(gsr.groundSteering()));
+                    }
+                }
+                std::stable_sort(groundTruth.begin(), groundTruth.end(),
+                                 [](const std::pair<int64_t, double> &a, const std::pair<int64_t, double> &b) { return a.first < b.first; });
+                return groundTruth;
+
+}
+
+
+int32_t main(int32_t argc, char **argv)
+{
+    int32_t retCode{1};
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    if (((0 == commandlineArguments.count("frames")) && (0 == commandlineArguments.count("raw"))) ||
+        ((0 != commandlineArguments.count("lut")) && !ConeColourLut::isValidBits(std::stoi(commandlineArguments["lut"]))) ||
+        ((0 != commandlineArguments.count("near-scale")) && !FrameWorkspace::isValidReduction(static_cast<uint32_t>(std::stoi(commandlineArguments["near-scale"])))))
+    {
+        std::cerr << argv[0] << " runs the cone pipeline over decoded frames as fast as possible." << std::endl;
+        std::cerr << "Usage:   " << argv[0] << " --frames=<pattern>|--raw=<file> [--rec=<recording>] [--repeat=<n>] [--roi-top=<row>] [--roi-height=<rows>] [--lut=<5|6|8>] [--min-cone-area=<pixels>] [--max-cone-area=<pixels>] [--parallel-channels] [--track-rescan=<frames>] [--near-band=<rows>] [--near-scale=<2|4>] [--packed-masks] [--calibration=<file>] [--verbose]" << std::endl;
+        std::cerr << "         --frames: images to process, e.g. 'frames/*.png'; each file is named by its sample time stamp in microseconds" << std::endl;
+        std::cerr << "         --raw:    raw frame file written by template-opencv --capture; replayed from memory without decoding" << std::endl;
+        std::cerr << "         --rec:    recording whose ground steering requests are the reference for the accuracy" << std::endl;
+        std::cerr << "         --repeat: number of passes over all frames (default: 1)" << std::endl;
+        std::cerr << "         With --track-rescan, --near-band or --packed-masks the steering is also compared with a full search at full resolution." << std::endl;
+        std::cerr << "         --verbose: print the steering angle of every frame as the microservice does" << std::endl;
+        std::cerr << "         The other options are the same as for template-opencv." << std::endl;
+        std::cerr << "Example: " << argv[0] << " --frames='frames/*.png' --rec=DATA/REC1_144821.rec" << std::endl;
+        std::cerr << "         " << argv[0] << " --raw=frames.raw --rec=DATA/REC1_144821.rec --repeat=10" << std::endl;
+        return retCode;
+    }
+
+    const bool VERBOSE{commandlineArguments.count("verbose") != 0};
+    const uint32_t REPEAT{(commandlineArguments.count("repeat") != 0) ? static_cast<uint32_t>(std::max(1, std::stoi(commandlineArguments["repeat"]))) : 1};
+    const uint32_t MIN_CONE_AREA{(commandlineArguments.count("min-cone-area") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["min-cone-area"])) : 1};
+    const uint32_t MAX_CONE_AREA{(commandlineArguments.count("max-cone-area") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["max-cone-area"])) : std::numeric_limits<uint32_t>::max()};
+    const uint32_t LUT_BITS{(commandlineArguments.count("lut") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["lut"])) : 0};
+    const bool PARALLEL_CHANNELS{commandlineArguments.count("parallel-channels") != 0};
+    const uint32_t TRACK_RESCAN{(commandlineArguments.count("track-rescan") != 0) ? static_cast<uint32_t>(std::max(0, std::stoi(commandlineArguments["track-rescan"]))) : 0};
+    const uint32_t NEAR_BAND{(commandlineArguments.count("near-band") != 0) ? static_cast<uint32_t>(std::max(0, std::stoi(commandlineArguments["near-band"]))) : 0};
+    const uint32_t NEAR_SCALE{(commandlineArguments.count("near-scale") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["near-scale"])) : 2};
+    const bool PACKED_MASKS{commandlineArguments.count("packed-masks") != 0};
+    const std::string CALIBRATION{(commandlineArguments.count("calibration") != 0) ? commandlineArguments["calibration"] : ""};
+    Homography perspective{getMatrix()};
+    if (!CALIBRATION.empty() && !Homography::load(CALIBRATION, perspective))
+    {
+        std::cerr << argv[0] << ": Failed to read the calibration '" << CALIBRATION << "'." << std::endl;
+        return retCode;
+    }
+
+    // Frames are mapped or decoded up front so that only the pipeline is measured
+    std::unique_ptr<RawFrameReplay> replay;
+    std::vector<BenchFrame> frames;
+    if (0 != commandlineArguments.count("raw"))
+    {
+        replay.reset(new RawFrameReplay{commandlineArguments["raw"]});
+        if (replay->valid() && (4 == replay->bytesPerPixel()))
+        {
+            for (std::size_t i = 0; i < replay->frames(); i++)
+            {
+                frames.push_back(BenchFrame{replay->sampleTimeStamp(i),
+                                            cv::Mat(static_cast<int>(replay->height()), static_cast<int>(replay->width()), CV_8UC4, const_cast<char *>(replay->data(i)))});
+            }
+        }
+    }
+    else
+    {
+        std::vector<cv::String> files;
+        cv::glob(commandlineArguments["frames"], files, false);
+        for (const cv::String &file : files)
+        {
+            const int64_t sampleTimeStamp{timeStampOfFile(file)};
+            const cv::Mat image{cv::imread(file, cv::IMREAD_COLOR)};
+            if ((0 > sampleTimeStamp) || image.empty())
+            {
+                std::cerr << argv[0] << ": Skipping '" << file << "'." << std::endl;
+                continue;
+            }
+            BenchFrame frame{sampleTimeStamp, cv::Mat{}};
+            cv::cvtColor(image, frame.bgra, cv::COLOR_BGR2BGRA);
+            if (!frames.empty() && (frame.bgra.size() != frames.front().bgra.size()))
+            {
+                std::cerr << argv[0] << ": Skipping '" << file << "' as its size differs from the first frame." << std::endl;
+                continue;
+            }
+            frames.push_back(frame);
+        }
+    }
+    if (frames.empty())
+    {
+        std::cerr << argv[0] << ": No frames found." << std::endl;
+        return retCode;
+    }
+    std::sort(frames.begin(), frames.end(), [](const BenchFrame &a, const BenchFrame &b) { return a.sampleTimeStamp < b.sampleTimeStamp; });
+
+    const uint32_t WIDTH{static_cast<uint32_t>(frames.front().bgra.cols)};
+    const uint32_t HEIGHT{static_cast<uint32_t>(frames.front().bgra.rows)};
+    const uint32_t ROI_TOP{(commandlineArguments.count("roi-top") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["roi-top"])) : HEIGHT / 2};
+    const uint32_t ROI_HEIGHT{(commandlineArguments.count("roi-height") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["roi-height"])) : 120};
+
+    // The whole recording fits into the history, so frames are matched exactly as in the microservice
+    std::vector<std::pair<int64_t, double>> recorded;
+    if (0 != commandlineArguments.count("rec"))
+    {
+        recorded = readGroundTruth(commandlineArguments["rec"]);
+        std::clog << argv[0] << ": " << recorded.size() << " ground steering requests in '" << commandlineArguments["rec"] << "'." << std::endl;
+    }
+    SteeringHistory groundTruth{recorded.size()};
+    for (const std::pair<int64_t, double> &sample : recorded)
+    {
+        groundTruth.push(sample.first, sample.second);
+    }
+
+    const ConeColourClassifier exactClassifier;
+    std::unique_ptr<ConeColourLut> lut;
+    if (0 != LUT_BITS)
+    {
+        lut.reset(new ConeColourLut{exactClassifier, LUT_BITS});
+    }
+    const ConeClassifier &classifier = lut ? static_cast<const ConeClassifier &>(*lut) : exactClassifier;
+
+    FrameWorkspace ws{WIDTH, HEIGHT, ROI_TOP, ROI_HEIGHT, perspective, MIN_CONE_AREA, MAX_CONE_AREA};
+    ws.useNearBand(NEAR_BAND, NEAR_SCALE);
+    if (PACKED_MASKS)
+    {
+        ws.usePackedMasks();
+    }
+
+    StageLatencies latencies;
+    LatencyHistogram &ingestLatency = latencies.add("ingest");
+    WorkerPool channelPool{(PARALLEL_CHANNELS && (1 < std::thread::hardware_concurrency())) ? 1u : 0u};
+
+    // The same stages as the microservice; only the output differs
+    SteeringAccuracy accuracy;
+    ResultWriter results{std::unique_ptr<ResultSink>(new FileResultSink), std::chrono::milliseconds(5), std::chrono::milliseconds(20)};
+    std::vector<ConeStage> stages;
+    std::unique_ptr<ConeTracker> tracker;
+    if (0 < TRACK_RESCAN)
+    {
+        tracker.reset(new ConeTracker{ws.perspective, ws.crop, TRACK_RESCAN});
+    }
+    addConeStages(stages, latencies, classifier, PARALLEL_CHANNELS ? &channelPool : nullptr, tracker.get());
+    stages.push_back(timedStage(latencies, "output", [&accuracy, &groundTruth, &results, VERBOSE](FrameWorkspace &slot) {
+        if (0 < groundTruth.size())
+        {
+            accuracy.add(slot.actual_steeringAngle, slot.calculated_steeringAngle);
+        }
+        if (VERBOSE)
+        {
+            results.push(slot.sampleTimeStamp, slot.calculated_steeringAngle);
+        }
+    }));
+
+    // Tracking, the near band and the packed masks trade precision for speed; their steering is compared with
+    // the steering of a full search at full resolution, which is computed before the measured passes
+    std::vector<double> reference;
+    if (tracker || ws.near || ws.yellow.packed)
+    {
+        FrameWorkspace referenceWs{WIDTH, HEIGHT, ROI_TOP, ROI_HEIGHT, perspective, MIN_CONE_AREA, MAX_CONE_AREA};
+        StageLatencies referenceLatencies;
+        std::vector<ConeStage> referenceStages;
+        addConeStages(referenceStages, referenceLatencies, classifier, nullptr, nullptr);
+        for (const BenchFrame &frame : frames)
+        {
+            referenceWs.sampleTimeStamp = frame.sampleTimeStamp;
+            ingestFrame(reinterpret_cast<const char *>(frame.bgra.ptr<uint8_t>()), referenceWs, false);
+            for (const ConeStage &stage : referenceStages)
+            {
+                stage.process(referenceWs);
+            }
+            reference.push_back(referenceWs.calculated_steeringAngle);
+        }
+    }
+    SteeringAccuracy agreement;
+    uint64_t identical{0};
+    double absoluteDifference{0.0};
+
+    const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+    for (uint32_t pass = 0; pass < REPEAT; pass++)
+    {
+        for (std::size_t i = 0; i < frames.size(); i++)
+        {
+            const BenchFrame &frame = frames[i];
+            ws.sampleTimeStamp = frame.sampleTimeStamp;
+            ws.actual_steeringAngle = groundTruth.at(frame.sampleTimeStamp);
+
+            const LatencyHistogram::Clock::time_point ingestStart{LatencyHistogram::Clock::now()};
+            ingestFrame(reinterpret_cast<const char *>(frame.bgra.ptr<uint8_t>()), ws, false);
+            ingestLatency.recordSince(ingestStart);
+
+            for (const ConeStage &stage : stages)
+            {
+                stage.process(ws);
+            }
+
+            if (!reference.empty())
+            {
+                agreement.add(reference[i], ws.calculated_steeringAngle);
+                identical += ((ws.calculated_steeringAngle >= reference[i]) && (ws.calculated_steeringAngle <= reference[i])) ? 1 : 0;
+                absoluteDifference += std::fabs(ws.calculated_steeringAngle - reference[i]);
+            }
+        }
+    }
+    const double seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    const double processed{static_cast<double>(frames.size()) * REPEAT};
+    results.stop();
+
+    std::cout << "frames:   " << frames.size() << " x " << REPEAT << " in " << seconds << " s, " << (processed / seconds) << " frames/s" << std::endl;
+    latencies.report(std::cout);
+    if (tracker)
+    {
+        tracker->report(std::cout);
+    }
+    if (!reference.empty())
+    {
+        std::cout << "vs. full search at full resolution: " << (100.0 * static_cast<double>(identical) / processed) << "% identical, mean difference "
+                  << (absoluteDifference / processed) << ", straight_correct_p=" << agreement.straight_correct_p << "%, turning_correct_p="
+                  << agreement.turning_correct_p << "%, total_p=" << agreement.total_p << "%" << std::endl;
+    }
+    if (0 < groundTruth.size())
+    {
+        std::cout << "accuracy: straight_correct_p=" << accuracy.straight_correct_p << "% of " << accuracy.straight_total
+                  << " frames, turning_correct_p=" << accuracy.turning_correct_p << "% of " << accuracy.turning_total
+                  << " frames, total_p=" << accuracy.total_p << "%" << std::endl;
+    }
+    retCode = 0;
+    return retCode;
+}
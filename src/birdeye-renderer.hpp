@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BIRDEYE_RENDERER_HPP
+#define BIRDEYE_RENDERER_HPP
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <vector>
+
+// Debug view of the detected cones on top of the warped frame. Detection only
+// ever transforms the cone centroids; warping the whole frame is left to this
+// renderer, which is only invoked when somebody looks at the result. The
+// canvas is allocated on the first call and reused afterwards.
+class BirdEyeRenderer
+{
+  public:
+    BirdEyeRenderer(const cv::Mat &perspective, const cv::Size &size = cv::Size(640, 480))
+        : m_perspective(perspective.clone())
+        , m_size(size)
+    {
+    }
+
+    const cv::Mat &render(const cv::Mat &frame, const std::vector<cv::Point2f> &yellowCones, const std::vector<cv::Point2f> &blueCones)
+    {
+        cv::warpPerspective(frame, m_canvas, m_perspective, m_size, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+        drawCones(yellowCones);
+        drawCones(blueCones);
+        return m_canvas;
+    }
+
+  private:
+    void drawCones(const std::vector<cv::Point2f> &cones)
+    {
+        for (const cv::Point2f &cone : cones)
+        {
+            cv::circle(m_canvas, cone, 10, cv::Scalar(0, 0, 255), 1, CV_AA, 0);
+        }
+    }
+
+  private:
+    cv::Mat m_perspective;
+    cv::Size m_size;
+    cv::Mat m_canvas{};
+};
+
+#endif
@@ -6098,16 +6098,51 @@ class LIBCLUON_API TerminateHandler {
 //#include "cluon/cluon.hpp"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <deque>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace cluon {
 
+/**
+ * This class queues entries from any number of producers on a bounded
+ * lock-free ring and passes them by move to a delegate that runs in its own
+ * thread. The thread drains all available entries at once into a batch,
+ * which frees their slots before the delegate is called for any of them.
+ * Producers call add() and then notifyAll() to wake the thread.
+ *
+ * When the ring is full, the OverflowPolicy decides: BLOCK lets add() wait
+ * for a free slot, DROP_OLDEST discards the oldest queued entry and
+ * DROP_NEWEST discards the one to be added; statistics() counts all of them.
+ * These types do not depend on the entries, so owners of a pipeline can pass
+ * them on through NotifyingPipelineBase.
+ */
+class LIBCLUON_API NotifyingPipelineBase {
+   public:
+    enum class OverflowPolicy : uint8_t {
+        BLOCK,
+        DROP_OLDEST,
+        DROP_NEWEST,
+    };
+
+    struct Statistics {
+        uint64_t added{0};
+        uint64_t processed{0};
+        uint64_t dropped{0};
+        uint64_t blocked{0};
+    };
+
+    static constexpr std::size_t DEFAULT_CAPACITY{1024};
+};
+
 template <class T>
-class LIBCLUON_API NotifyingPipeline {
+class LIBCLUON_API NotifyingPipeline : public NotifyingPipelineBase {
    private:
     NotifyingPipeline(const NotifyingPipeline &) = delete;
     NotifyingPipeline(NotifyingPipeline &&)      = delete;
@@ -6115,8 +6150,27 @@ class LIBCLUON_API NotifyingPipeline {
     NotifyingPipeline &operator=(NotifyingPipeline &&) = delete;
 
    public:
-    NotifyingPipeline(std::function<void(T &&)> delegate)
-        : m_delegate(delegate) {
+    /**
+     * Constructor.
+     *
+     * @param delegate Function to call for every entry.
+     * @param capacity Number of entries that can be queued; rounded up to a power of two.
+     * @param overflowPolicy What add() does when capacity entries are queued already.
+     */
+    NotifyingPipeline(std::function<void(T &&)> delegate, std::size_t capacity = DEFAULT_CAPACITY, OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK)
+        : m_delegate(delegate)
+        , m_overflowPolicy(overflowPolicy) {
+        std::size_t size{2};
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask  = size - 1;
+        m_slots = std::unique_ptr<Slot[]>(new Slot[size]);
+        for (std::size_t i{0}; i < size; i++) {
+            m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+        m_batch.reserve(size);
+
         m_pipelineThread = std::thread(&NotifyingPipeline::processPipeline, this);
 
         // Let the operating system spawn the thread.
@@ -6128,7 +6182,7 @@ class LIBCLUON_API NotifyingPipeline {
         m_pipelineThreadRunning.store(false);
 
         // Wake any waiting threads.
-        m_pipelineCondition.notify_all();
+        notifyAll();
 
         // Joining the thread could fail.
         try {
@@ -6139,65 +6193,173 @@ class LIBCLUON_API NotifyingPipeline {
     }
 
    public:
-    inline void add(T &&entry) noexcept {
-        std::unique_lock<std::mutex> lck(m_pipelineMutex);
-        m_pipeline.emplace_back(entry);
+    /**
+     * This method queues an entry without taking a lock unless the ring is
+     * full and the OverflowPolicy is BLOCK.
+     *
+     * @return true if the entry was queued.
+     */
+    inline bool add(T &&entry) noexcept {
+        bool hasWaited{false};
+        while (!tryPush(entry)) {
+            if (OverflowPolicy::DROP_NEWEST == m_overflowPolicy) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                // The producer may not have notified the thread of the full ring yet.
+                notifyAll();
+                return false;
+            }
+            if (OverflowPolicy::DROP_OLDEST == m_overflowPolicy) {
+                T oldest;
+                if (tryPop(oldest)) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+                continue;
+            }
+
+            // BLOCK: the entries queued so far may not have been notified yet.
+            if (!m_pipelineThreadRunning.load()) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (!hasWaited) {
+                hasWaited = true;
+                m_blocked.fetch_add(1, std::memory_order_relaxed);
+            }
+            notifyAll();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        m_added.fetch_add(1, std::memory_order_relaxed);
+        return true;
     }
 
-    inline void notifyAll() noexcept { m_pipelineCondition.notify_all(); }
+    inline void notifyAll() noexcept {
+        // Taking the lock orders the notification after a waiting thread's check for entries.
+        try {
+            std::lock_guard<std::mutex> lck(m_pipelineMutex);
+        } catch (...) {} // LCOV_EXCL_LINE
+        m_pipelineCondition.notify_all();
+    }
 
     inline bool isRunning() noexcept { return m_pipelineThreadRunning.load(); }
 
+    inline Statistics statistics() const noexcept {
+        Statistics retVal;
+        retVal.added     = m_added.load(std::memory_order_relaxed);
+        retVal.processed = m_processed.load(std::memory_order_relaxed);
+        retVal.dropped   = m_dropped.load(std::memory_order_relaxed);
+        retVal.blocked   = m_blocked.load(std::memory_order_relaxed);
+        return retVal;
+    }
+
    private:
+    // A slot is free for the producer at position p when its sequence is p
+    // and holds an entry for the consumer at position p when it is p + 1.
+    struct Slot {
+        std::atomic<std::size_t> m_sequence{0};
+        T m_entry{};
+    };
+
+    inline bool tryPush(T &entry) noexcept {
+        std::size_t pos{m_tail.load(std::memory_order_relaxed)};
+        Slot *slot{nullptr};
+        for (;;) {
+            slot                 = &m_slots[pos & m_mask];
+            const std::size_t SEQ{slot->m_sequence.load(std::memory_order_acquire)};
+            // Subtracted unsigned, so the positions may wrap around.
+            const intptr_t DIFF{static_cast<intptr_t>(SEQ - pos)};
+            if (0 == DIFF) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (DIFF < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->m_entry = std::move(entry);
+        slot->m_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool tryPop(T &entry) noexcept {
+        std::size_t pos{m_head.load(std::memory_order_relaxed)};
+        Slot *slot{nullptr};
+        for (;;) {
+            slot                 = &m_slots[pos & m_mask];
+            const std::size_t SEQ{slot->m_sequence.load(std::memory_order_acquire)};
+            // Subtracted unsigned, so the positions may wrap around.
+            const intptr_t DIFF{static_cast<intptr_t>(SEQ - (pos + 1))};
+            if (0 == DIFF) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (DIFF < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        entry = std::move(slot->m_entry);
+        slot->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool isEmpty() const noexcept {
+        const std::size_t POS{m_head.load(std::memory_order_acquire)};
+        return m_slots[POS & m_mask].m_sequence.load(std::memory_order_acquire) != POS + 1;
+    }
+
     inline void processPipeline() noexcept {
         // Indicate to caller that we are ready.
         m_pipelineThreadRunning.store(true);
 
         while (m_pipelineThreadRunning.load()) {
-            std::unique_lock<std::mutex> lck(m_pipelineMutex);
-            // Wait until the thread should stop or data is available.
-            m_pipelineCondition.wait(lck, [this] { return (!this->m_pipelineThreadRunning.load() || !this->m_pipeline.empty()); });
-
-            // The condition will automatically lock the mutex after waking up.
-            // As we are locking per entry, we need to unlock the mutex first.
-            lck.unlock();
-
-            uint32_t entries{0};
             {
-                lck.lock();
-                entries = static_cast<uint32_t>(m_pipeline.size());
-                lck.unlock();
+                std::unique_lock<std::mutex> lck(m_pipelineMutex);
+                // Wait until the thread should stop or data is available.
+                m_pipelineCondition.wait(lck, [this] { return (!this->m_pipelineThreadRunning.load() || !this->isEmpty()); });
             }
-            for (uint32_t i{0}; i < entries; i++) {
-                T entry;
-                {
-                    lck.lock();
-                    entry = m_pipeline.front();
-                    lck.unlock();
-                }
 
-                if (nullptr != m_delegate) {
-                    m_delegate(std::move(entry));
+            // Move everything that is queued into the batch, then deliver it.
+            do {
+                T entry;
+                while ((m_batch.size() <= m_mask) && tryPop(entry)) {
+                    m_batch.push_back(std::move(entry));
                 }
-
-                {
-                    lck.lock();
-                    m_pipeline.pop_front();
-                    lck.unlock();
+                for (T &e : m_batch) {
+                    if (nullptr != m_delegate) {
+                        m_delegate(std::move(e));
+                    }
                 }
-            }
+                m_processed.fetch_add(m_batch.size(), std::memory_order_relaxed);
+                m_batch.clear();
+            } while (m_pipelineThreadRunning.load() && !isEmpty());
         }
     }
 
    private:
     std::function<void(T &&)> m_delegate;
+    const OverflowPolicy m_overflowPolicy;
 
     std::atomic<bool> m_pipelineThreadRunning{false};
     std::thread m_pipelineThread{};
     std::mutex m_pipelineMutex{};
     std::condition_variable m_pipelineCondition{};
 
-    std::deque<T> m_pipeline{};
+    std::unique_ptr<Slot[]> m_slots{};
+    std::size_t m_mask{0};
+    // Producers and the consumer advance different positions; keep them on different cache lines.
+    std::atomic<std::size_t> m_tail{0};
+    char m_tailPadding[64 - sizeof(std::atomic<std::size_t>)]{};
+    std::atomic<std::size_t> m_head{0};
+    char m_headPadding[64 - sizeof(std::atomic<std::size_t>)]{};
+    std::vector<T> m_batch{};
+
+    std::atomic<uint64_t> m_added{0};
+    std::atomic<uint64_t> m_processed{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_blocked{0};
 };
 } // namespace cluon
 
@@ -6363,6 +6525,9 @@ class LIBCLUON_API UDPSender {
     #include <ws2tcpip.h> // for SOCKET
 #else
     #include <netinet/in.h>
+    #ifdef __linux__
+        #include <sys/socket.h>
+    #endif
 #endif
 // clang-format on
 
@@ -6377,6 +6542,7 @@ class LIBCLUON_API UDPSender {
 #include <set>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace cluon {
 /**
@@ -6413,6 +6579,11 @@ activated and concurrently waiting for data in a separate thread. To check
 whether the instance was created successfully and running, the method
 `isRunning()` should be called.
 
+On Linux, up to datagramsPerRead datagrams are fetched with a single call to
+`recvmmsg` into buffers that are allocated once, and the time stamps are the
+ones the kernel took on arrival (`SO_TIMESTAMPNS`). The size of the socket's
+receive buffer can be chosen to absorb bursts.
+
 A complete example is available
 [here](https://github.com/chrberger/libcluon/blob/master/libcluon/examples/cluon-UDPReceiver.cpp).
 */
@@ -6424,6 +6595,9 @@ class LIBCLUON_API UDPReceiver {
     UDPReceiver &operator=(UDPReceiver &&) = delete;
 
    public:
+    static constexpr int32_t DEFAULT_RECEIVE_BUFFER_SIZE{26214400};
+    static constexpr uint16_t DEFAULT_DATAGRAMS_PER_READ{16};
+
     /**
      * Constructor.
      *
@@ -6431,11 +6605,19 @@ class LIBCLUON_API UDPReceiver {
      * @param receiveFromPort Port to receive UDP packets from.
      * @param delegate Functional (noexcept) to handle received bytes; parameters are received data, sender, timestamp.
      * @param localSendFromPort Port that an application is using to send data. This port (> 0) is ignored when data is received.
+     * @param receiveBufferSize Requested SO_RCVBUF in bytes; 0 keeps the default of the operating system.
+     * @param datagramsPerRead Maximum number of datagrams fetched with one system call (Linux only).
+     * @param pipelineCapacity Number of datagrams queued for the delegate.
+     * @param overflowPolicy What happens to a datagram while pipelineCapacity datagrams are queued; with BLOCK it waits in the receive buffer.
      */
     UDPReceiver(const std::string &receiveFromAddress,
                 uint16_t receiveFromPort,
                 std::function<void(std::string &&, std::string &&, std::chrono::system_clock::time_point &&)> delegate,
-                uint16_t localSendFromPort = 0) noexcept;
+                uint16_t localSendFromPort                           = 0,
+                int32_t receiveBufferSize                            = DEFAULT_RECEIVE_BUFFER_SIZE,
+                uint16_t datagramsPerRead                            = DEFAULT_DATAGRAMS_PER_READ,
+                std::size_t pipelineCapacity                         = NotifyingPipelineBase::DEFAULT_CAPACITY,
+                NotifyingPipelineBase::OverflowPolicy overflowPolicy = NotifyingPipelineBase::OverflowPolicy::BLOCK) noexcept;
     ~UDPReceiver() noexcept;
 
     /**
@@ -6443,6 +6625,11 @@ class LIBCLUON_API UDPReceiver {
      */
     bool isRunning() const noexcept;
 
+    /**
+     * @return Counters of the pipeline between the socket and the delegate.
+     */
+    NotifyingPipelineBase::Statistics pipelineStatistics() const noexcept;
+
    private:
     /**
      * This method closes the socket.
@@ -6453,11 +6640,19 @@ class LIBCLUON_API UDPReceiver {
 
     void readFromSocket() noexcept;
 
+    /**
+     * This method queues one received datagram unless it was sent by ourselves.
+     *
+     * @return true if the datagram was queued.
+     */
+    bool enqueue(const char *data, std::size_t length, const struct sockaddr_storage &remote, std::chrono::system_clock::time_point timestamp) noexcept;
+
    private:
     int32_t m_socket{-1};
     bool m_isBlockingSocket{true};
     std::set<unsigned long> m_listOfLocalIPAddresses{};
     uint16_t m_localSendFromPort;
+    uint16_t m_datagramsPerRead;
     struct sockaddr_in m_receiveFromAddress {};
     struct ip_mreq m_mreq {};
     bool m_isMulticast{false};
@@ -6465,6 +6660,15 @@ class LIBCLUON_API UDPReceiver {
     std::atomic<bool> m_readFromSocketThreadRunning{false};
     std::thread m_readFromSocketThread{};
 
+#ifdef __linux__
+    // One buffer, sender address and control message area per datagram of a batch.
+    std::vector<char> m_buffers{};
+    std::vector<char> m_controls{};
+    std::vector<struct sockaddr_storage> m_remotes{};
+    std::vector<struct iovec> m_iovecs{};
+    std::vector<struct mmsghdr> m_messages{};
+#endif
+
    private:
     std::function<void(std::string &&, std::string &&, std::chrono::system_clock::time_point)> m_delegate{};
 
@@ -8118,6 +8322,200 @@ inline std::pair<bool, cluon::data::Envelope> extractEnvelope(std::istream &in)
     return std::make_pair(retVal, env);
 }
 
+/**
+ * This class holds the fields of an Envelope decoded in place from a buffer:
+ * serializedData is only a view into that buffer, which must outlive the
+ * EnvelopeView; toEnvelope() creates an Envelope that owns a copy of it.
+ */
+class LIBCLUON_API EnvelopeView {
+   public:
+    int32_t dataType{0};
+    const char *serializedData{nullptr};
+    std::size_t serializedDataSize{0};
+    cluon::data::TimeStamp sent{};
+    cluon::data::TimeStamp received{};
+    cluon::data::TimeStamp sampleTimeStamp{};
+    uint32_t senderStamp{0};
+
+   public:
+    /**
+     * @return Envelope with a copy of the payload.
+     */
+    cluon::data::Envelope toEnvelope() const noexcept {
+        cluon::data::Envelope env;
+        env.dataType(dataType)
+            .serializedData((nullptr != serializedData) ? std::string(serializedData, serializedDataSize) : std::string())
+            .sent(sent)
+            .received(received)
+            .sampleTimeStamp(sampleTimeStamp)
+            .senderStamp(senderStamp);
+        return env;
+    }
+};
+
+namespace detail {
+/**
+ * Reads a VarInt at pos that must end before end.
+ *
+ * @return true if the VarInt was complete.
+ */
+inline bool readVarInt(const char *&pos, const char *end, uint64_t &value) noexcept {
+    value = 0;
+    for (uint32_t shift{0}; (pos < end) && (shift < 64); shift += 7) {
+        const uint8_t c{static_cast<uint8_t>(*pos++)};
+        value |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (0 == (c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int32_t fromZigZag32(uint64_t v) noexcept {
+    const uint32_t u{static_cast<uint32_t>(v)};
+    return static_cast<int32_t>((u >> 1) ^ -(u & 1));
+}
+
+/**
+ * Decodes the Proto-encoded fields of a cluon::data::TimeStamp in [pos, end).
+ */
+inline void decodeTimeStamp(const char *pos, const char *end, cluon::data::TimeStamp &ts) noexcept {
+    uint64_t key{0};
+    uint64_t value{0};
+    while ((pos < end) && readVarInt(pos, end, key) && (0 == (key & 0x7)) && readVarInt(pos, end, value)) {
+        if (1 == (key >> 3)) {
+            ts.seconds(fromZigZag32(value));
+        } else if (2 == (key >> 3)) {
+            ts.microseconds(fromZigZag32(value));
+        }
+    }
+}
+} // namespace detail
+
+/**
+ * This method extracts an Envelope in place from a buffer that holds bytes in
+ * the same format as extractEnvelope(std::istream&) expects. Nothing is
+ * copied: serializedData of the returned EnvelopeView points into the buffer.
+ * Bytes after the Envelope are ignored.
+ *
+ * @param data Buffer to decode from.
+ * @param length Number of bytes in data.
+ * @return true and the EnvelopeView if the header was complete and the buffer
+ *         holds as many bytes as the header announces.
+ */
+inline std::pair<bool, EnvelopeView> extractEnvelope(const char *data, std::size_t length) noexcept {
+    constexpr uint8_t OD4_HEADER_SIZE{5};
+    EnvelopeView env;
+    if ((nullptr == data) || (OD4_HEADER_SIZE > length) || (0x0D != static_cast<uint8_t>(data[0])) || (0xA4 != static_cast<uint8_t>(data[1]))) {
+        return std::make_pair(false, env);
+    }
+    const uint32_t LENGTH{static_cast<uint32_t>(static_cast<uint8_t>(data[2])) | (static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 8)
+                          | (static_cast<uint32_t>(static_cast<uint8_t>(data[4])) << 16)};
+    if (length - OD4_HEADER_SIZE < LENGTH) {
+        return std::make_pair(false, env);
+    }
+
+    const char *pos{data + OD4_HEADER_SIZE};
+    const char *end{pos + LENGTH};
+    uint64_t key{0};
+    uint64_t value{0};
+    while ((pos < end) && detail::readVarInt(pos, end, key)) {
+        const uint32_t fieldId{static_cast<uint32_t>(key >> 3)};
+        const uint8_t protoType{static_cast<uint8_t>(key & 0x7)};
+        if (0 == protoType) {
+            if (!detail::readVarInt(pos, end, value)) {
+                break;
+            }
+            if (1 == fieldId) {
+                env.dataType = detail::fromZigZag32(value);
+            } else if (6 == fieldId) {
+                env.senderStamp = static_cast<uint32_t>(value);
+            }
+        } else if (2 == protoType) {
+            if (!detail::readVarInt(pos, end, value) || (static_cast<uint64_t>(end - pos) < value)) {
+                break;
+            }
+            const char *fieldEnd{pos + value};
+            if (2 == fieldId) {
+                env.serializedData     = pos;
+                env.serializedDataSize = static_cast<std::size_t>(value);
+            } else if (3 == fieldId) {
+                detail::decodeTimeStamp(pos, fieldEnd, env.sent);
+            } else if (4 == fieldId) {
+                detail::decodeTimeStamp(pos, fieldEnd, env.received);
+            } else if (5 == fieldId) {
+                detail::decodeTimeStamp(pos, fieldEnd, env.sampleTimeStamp);
+            }
+            pos = fieldEnd;
+        } else if ((1 == protoType) || (5 == protoType)) {
+            // Fixed-size fields are not part of an Envelope; skip them.
+            const std::size_t size{(1 == protoType) ? sizeof(double) : sizeof(float)};
+            if (static_cast<std::size_t>(end - pos) < size) {
+                break;
+            }
+            pos += size;
+        } else {
+            break;
+        }
+    }
+    return std::make_pair(true, env);
+}
+
+/**
+ * This method reads only the dataType of an Envelope from a buffer in the
+ * format extractEnvelope(const char*, std::size_t) expects. It stops at the
+ * dataType field, which is usually the first one, so an Envelope that is not
+ * of interest can be dropped without decoding or copying anything.
+ *
+ * @param data Buffer to read from.
+ * @param length Number of bytes in data.
+ * @param dataType dataType of the Envelope; 0 if the Envelope has none.
+ * @return true if the buffer holds a complete Envelope with a readable dataType.
+ */
+inline bool peekDataType(const char *data, std::size_t length, int32_t &dataType) noexcept {
+    constexpr uint8_t OD4_HEADER_SIZE{5};
+    dataType = 0;
+    if ((nullptr == data) || (OD4_HEADER_SIZE > length) || (0x0D != static_cast<uint8_t>(data[0])) || (0xA4 != static_cast<uint8_t>(data[1]))) {
+        return false;
+    }
+    const uint32_t LENGTH{static_cast<uint32_t>(static_cast<uint8_t>(data[2])) | (static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 8)
+                          | (static_cast<uint32_t>(static_cast<uint8_t>(data[4])) << 16)};
+    if (length - OD4_HEADER_SIZE < LENGTH) {
+        return false;
+    }
+
+    const char *pos{data + OD4_HEADER_SIZE};
+    const char *end{pos + LENGTH};
+    uint64_t key{0};
+    uint64_t value{0};
+    while ((pos < end) && detail::readVarInt(pos, end, key)) {
+        const uint8_t protoType{static_cast<uint8_t>(key & 0x7)};
+        if (0 == protoType) {
+            if (!detail::readVarInt(pos, end, value)) {
+                return false;
+            }
+            if (1 == (key >> 3)) {
+                dataType = detail::fromZigZag32(value);
+                return true;
+            }
+        } else if (2 == protoType) {
+            if (!detail::readVarInt(pos, end, value) || (static_cast<uint64_t>(end - pos) < value)) {
+                return false;
+            }
+            pos += value;
+        } else if ((1 == protoType) || (5 == protoType)) {
+            const std::size_t size{(1 == protoType) ? sizeof(double) : sizeof(float)};
+            if (static_cast<std::size_t>(end - pos) < size) {
+                return false;
+            }
+            pos += size;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * @return Extract a given Envelope's payload into the desired type.
  */
@@ -8863,14 +9261,18 @@ class LIBCLUON_API LCMToGenericMessage {
 //#include "cluon/cluon.hpp"
 //#include "cluon/cluonDataStructures.hpp"
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace cluon {
 /**
@@ -8936,8 +9338,16 @@ class LIBCLUON_API OD4Session {
      *        if a nullptr is passed, the method dataTrigger can be used to set
      *        message specific delegates. Please note that it is NOT possible
      *        to have both: a delegate for "catch-all" and the data-triggered ones.
+     * @param receiveBufferSize Requested SO_RCVBUF in bytes of the receiving socket; 0 keeps the default of the operating system.
+     * @param pipelineCapacity Number of Envelopes queued for the delegates.
+     * @param overflowPolicy What happens to an Envelope while pipelineCapacity Envelopes are queued; with BLOCK it waits in the receive buffer.
      */
-    OD4Session(uint16_t CID, std::function<void(cluon::data::Envelope &&envelope)> delegate = nullptr) noexcept;
+    OD4Session(uint16_t CID,
+               std::function<void(cluon::data::Envelope &&envelope)> delegate = nullptr,
+               int32_t receiveBufferSize                                       = UDPReceiver::DEFAULT_RECEIVE_BUFFER_SIZE,
+               std::size_t pipelineCapacity                                    = NotifyingPipelineBase::DEFAULT_CAPACITY,
+               NotifyingPipelineBase::OverflowPolicy overflowPolicy            = NotifyingPipelineBase::OverflowPolicy::BLOCK) noexcept;
+    ~OD4Session() noexcept;
 
     /**
      * This method will send a given Envelope to this OpenDaVINCI v4 session.
@@ -8948,7 +9358,10 @@ class LIBCLUON_API OD4Session {
 
     /**
      * This method sets a delegate to be called data-triggered on arrival
-     * of a new Envelope for a given message identifier.
+     * of a new Envelope for a given message identifier. It publishes a new
+     * version of the table of delegates; the receiving thread picks it up
+     * with the next Envelope and never waits for this method, nor this
+     * method for a delegate that is running.
      *
      * @param messageIdentifier Message identifier to assign a delegate.
      * @param delegate Function to call on newly arriving Envelopes; setting it to nullptr will erase it.
@@ -8998,9 +9411,44 @@ class LIBCLUON_API OD4Session {
    public:
     bool isRunning() noexcept;
 
+    /**
+     * Number of Envelopes of one dataType that arrived at this session:
+     * decoded ones were passed to a delegate, skipped ones were dropped
+     * after reading their dataType as no delegate wanted them.
+     */
+    struct EnvelopeCounters {
+        uint64_t decoded{0};
+        uint64_t skipped{0};
+    };
+
+    /**
+     * @return Copy of the counters for every dataType seen so far; only the
+     *         first MAX_COUNTED_DATA_TYPES different dataTypes are counted.
+     */
+    std::map<int32_t, EnvelopeCounters> envelopeCounters() noexcept;
+
+    /**
+     * @return Counters of the pipeline between the socket and the delegates.
+     */
+    NotifyingPipelineBase::Statistics pipelineStatistics() noexcept;
+
+    static constexpr std::size_t MAX_COUNTED_DATA_TYPES{512};
+
+   private:
+    using DataTriggeredDelegates = std::unordered_map<int32_t, std::function<void(cluon::data::Envelope &&envelope)>, UseUInt32ValueAsHashKey>;
+
+    // Counters of one dataType in an open-addressing table that is filled without locks.
+    struct EnvelopeCounterSlot {
+        std::atomic<uint8_t> state{0}; // 0: free, 1: being claimed, 2: dataType is set.
+        int32_t dataType{0};
+        std::atomic<uint64_t> decoded{0};
+        std::atomic<uint64_t> skipped{0};
+    };
+
    private:
     void callback(std::string &&data, std::string &&from, std::chrono::system_clock::time_point &&timepoint) noexcept;
     void sendInternal(std::string &&dataToSend) noexcept;
+    EnvelopeCounterSlot *envelopeCounterSlot(int32_t dataType) noexcept;
 
    private:
     std::unique_ptr<cluon::UDPReceiver> m_receiver;
@@ -9010,8 +9458,16 @@ class LIBCLUON_API OD4Session {
 
     std::function<void(cluon::data::Envelope &&envelope)> m_delegate{nullptr};
 
+    // The receiving thread reads the current table through m_dataTriggeredDelegates without
+    // locking; dataTrigger() never changes a published table but replaces it with a new one.
+    // Replaced tables are kept until no callback is running that could still use them.
     std::mutex m_mapOfDataTriggeredDelegatesMutex{};
-    std::unordered_map<int32_t, std::function<void(cluon::data::Envelope &&envelope)>, UseUInt32ValueAsHashKey> m_mapOfDataTriggeredDelegates{};
+    std::unique_ptr<const DataTriggeredDelegates> m_mapOfDataTriggeredDelegates{};
+    std::vector<std::unique_ptr<const DataTriggeredDelegates>> m_retiredMapsOfDataTriggeredDelegates{};
+    std::atomic<const DataTriggeredDelegates *> m_dataTriggeredDelegates{nullptr};
+    std::atomic<uint32_t> m_callbacksInFlight{0};
+
+    std::array<EnvelopeCounterSlot, MAX_COUNTED_DATA_TYPES> m_envelopeCounters{};
 };
 
 } // namespace cluon
@@ -10207,8 +10663,13 @@ namespace cluon {
 inline UDPReceiver::UDPReceiver(const std::string &receiveFromAddress,
                          uint16_t receiveFromPort,
                          std::function<void(std::string &&, std::string &&, std::chrono::system_clock::time_point &&)> delegate,
-                         uint16_t localSendFromPort) noexcept
+                         uint16_t localSendFromPort,
+                         int32_t receiveBufferSize,
+                         uint16_t datagramsPerRead,
+                         std::size_t pipelineCapacity,
+                         NotifyingPipelineBase::OverflowPolicy overflowPolicy) noexcept
     : m_localSendFromPort(localSendFromPort)
+    , m_datagramsPerRead((0 < datagramsPerRead) ? datagramsPerRead : 1)
     , m_receiveFromAddress()
     , m_mreq()
     , m_readFromSocketThread()
@@ -10300,9 +10761,9 @@ inline UDPReceiver::UDPReceiver(const std::string &receiveFromAddress,
 #endif
         }
 
-        if (!(m_socket < 0)) {
+        if (!(m_socket < 0) && (0 < receiveBufferSize)) {
             // Try setting receiving buffer.
-            int recvBuffer{26214400};
+            int recvBuffer{receiveBufferSize};
             auto retVal = ::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char *>(&recvBuffer), sizeof(recvBuffer));
             if (retVal < 0) {
 #ifdef WIN32 // LCOV_EXCL_LINE
@@ -10312,7 +10773,44 @@ inline UDPReceiver::UDPReceiver(const std::string &receiveFromAddress,
 #endif                                                                                                                                       // LCOV_EXCL_LINE
                 std::cerr << "[cluon::UDPReceiver] Error while trying to set SO_RCVBUF to " << recvBuffer << ": " << errorCode << std::endl; // LCOV_EXCL_LINE
             }
+#ifdef __linux__
+            else {
+                // The kernel caps SO_RCVBUF at net.core.rmem_max; privileged processes may exceed it.
+                int actualBuffer{0};
+                socklen_t actualBufferLength{sizeof(actualBuffer)};
+                if ((0 == ::getsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &actualBuffer, &actualBufferLength)) && (actualBuffer < recvBuffer)) {
+                    ::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUFFORCE, &recvBuffer, sizeof(recvBuffer));
+                }
+            }
+#endif
+        }
+
+#ifdef __linux__
+        if (!(m_socket < 0)) {
+            // Let the kernel stamp every datagram on arrival; without it, the time of reading is used.
+            int enableTimestamps{1};
+            ::setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enableTimestamps, sizeof(enableTimestamps));
+        }
+
+        if (!(m_socket < 0)) {
+            // Allocate the buffers for a batch of datagrams once.
+            try {
+                constexpr std::size_t MAX_LENGTH{static_cast<uint16_t>(UDPPacketSizeConstraints::MAX_SIZE_UDP_PACKET)
+                                                 - static_cast<uint16_t>(UDPPacketSizeConstraints::SIZE_IPv4_HEADER)
+                                                 - static_cast<uint16_t>(UDPPacketSizeConstraints::SIZE_UDP_HEADER)};
+                constexpr std::size_t CONTROL_LENGTH{CMSG_SPACE(sizeof(struct timespec))};
+                m_buffers.resize(m_datagramsPerRead * MAX_LENGTH);
+                m_controls.resize(m_datagramsPerRead * CONTROL_LENGTH);
+                m_remotes.resize(m_datagramsPerRead);
+                m_iovecs.resize(m_datagramsPerRead);
+                m_messages.resize(m_datagramsPerRead);
+                for (std::size_t i{0}; i < m_datagramsPerRead; i++) {
+                    m_iovecs[i].iov_base = &m_buffers[i * MAX_LENGTH];
+                    m_iovecs[i].iov_len  = MAX_LENGTH;
+                }
+            } catch (...) { closeSocket(ENOMEM); } // LCOV_EXCL_LINE
         }
+#endif
 
         if (!(m_socket < 0)) {
             // Bind to receive address/port.
@@ -10398,8 +10896,11 @@ inline UDPReceiver::UDPReceiver(const std::string &receiveFromAddress,
             } catch (...) { closeSocket(ECHILD); } // LCOV_EXCL_LINE
 
             try {
+                // While the pipeline is full, datagrams wait in the socket's receive buffer unless the policy drops them.
                 m_pipeline = std::make_shared<cluon::NotifyingPipeline<PipelineEntry>>(
-                    [this](PipelineEntry &&entry) { this->m_delegate(std::move(entry.m_data), std::move(entry.m_from), std::move(entry.m_sampleTime)); });
+                    [this](PipelineEntry &&entry) { this->m_delegate(std::move(entry.m_data), std::move(entry.m_from), std::move(entry.m_sampleTime)); },
+                    pipelineCapacity,
+                    overflowPolicy);
                 if (m_pipeline) {
                     // Let the operating system spawn the thread.
                     using namespace std::literals::chrono_literals; // NOLINT
@@ -10463,6 +10964,117 @@ inline bool UDPReceiver::isRunning() const noexcept {
     return (m_readFromSocketThreadRunning.load() && !TerminateHandler::instance().isTerminated.load());
 }
 
+inline NotifyingPipelineBase::Statistics UDPReceiver::pipelineStatistics() const noexcept {
+    return m_pipeline ? m_pipeline->statistics() : NotifyingPipelineBase::Statistics{};
+}
+
+inline bool UDPReceiver::enqueue(const char *data, std::size_t length, const struct sockaddr_storage &remote, std::chrono::system_clock::time_point timestamp) noexcept {
+    const struct sockaddr_in *remoteAddress{reinterpret_cast<const struct sockaddr_in *>(&remote)}; // NOLINT
+    const unsigned long RECVFROM_IP{remoteAddress->sin_addr.s_addr};
+    const uint16_t RECVFROM_PORT{ntohs(remoteAddress->sin_port)};
+
+    // Check if the bytes actually came from us.
+    bool sentFromUs{false};
+    {
+        auto pos                   = m_listOfLocalIPAddresses.find(RECVFROM_IP);
+        const bool sentFromLocalIP = (pos != m_listOfLocalIPAddresses.end() && (*pos == RECVFROM_IP));
+        sentFromUs                 = sentFromLocalIP && (m_localSendFromPort == RECVFROM_PORT);
+    }
+
+    // Create a pipeline entry to be processed concurrently.
+    if (!sentFromUs && m_pipeline) {
+        try {
+            // Transform sender address to C-string.
+            std::array<char, INET6_ADDRSTRLEN> address{};
+            ::inet_ntop(remote.ss_family, &(remoteAddress->sin_addr), address.data(), address.max_size());
+
+            PipelineEntry pe;
+            pe.m_data       = std::string(data, length);
+            pe.m_from       = std::string(address.data()) + ':' + std::to_string(RECVFROM_PORT);
+            pe.m_sampleTime = timestamp;
+
+            // Store entry in queue; the overflow policy may drop it.
+            return m_pipeline->add(std::move(pe));
+        } catch (...) {} // LCOV_EXCL_LINE
+    }
+    return false;
+}
+
+#ifdef __linux__
+inline void UDPReceiver::readFromSocket() noexcept {
+    struct timeval timeout {};
+
+    // Define file descriptor set to watch for read operations.
+    fd_set setOfFiledescriptorsToReadFrom{};
+
+    // Indicate to main thread that we are ready.
+    m_readFromSocketThreadRunning.store(true);
+
+    while (m_readFromSocketThreadRunning.load()) {
+        // Define timeout for select system call. The timeval struct must be
+        // reinitialized for every select call as it might be modified containing
+        // the actual time slept.
+        timeout.tv_sec  = 0;
+        timeout.tv_usec = 20 * 1000; // Check for new data with 50Hz.
+
+        FD_ZERO(&setOfFiledescriptorsToReadFrom);          // NOLINT
+        FD_SET(m_socket, &setOfFiledescriptorsToReadFrom); // NOLINT
+        ::select(m_socket + 1, &setOfFiledescriptorsToReadFrom, nullptr, nullptr, &timeout);
+
+        bool hasQueued{false};
+        if (FD_ISSET(m_socket, &setOfFiledescriptorsToReadFrom)) { // NOLINT
+            const std::size_t CONTROL_LENGTH{m_controls.size() / m_datagramsPerRead};
+            int received{0};
+            do {
+                // recvmmsg overwrites the lengths of the addresses and control messages.
+                for (std::size_t i{0}; i < m_datagramsPerRead; i++) {
+                    struct msghdr &header{m_messages[i].msg_hdr};
+                    header.msg_name       = &m_remotes[i];
+                    header.msg_namelen    = sizeof(m_remotes[i]);
+                    header.msg_iov        = &m_iovecs[i];
+                    header.msg_iovlen     = 1;
+                    header.msg_control    = &m_controls[i * CONTROL_LENGTH];
+                    header.msg_controllen = CONTROL_LENGTH;
+                    header.msg_flags      = 0;
+                    m_messages[i].msg_len = 0;
+                }
+                received = ::recvmmsg(m_socket, m_messages.data(), m_datagramsPerRead, MSG_DONTWAIT, nullptr);
+
+                const std::chrono::system_clock::time_point now{std::chrono::system_clock::now()};
+                for (int i{0}; (i < received) && (nullptr != m_delegate); i++) {
+                    struct msghdr &header{m_messages[static_cast<std::size_t>(i)].msg_hdr};
+                    if (0 == m_messages[static_cast<std::size_t>(i)].msg_len) {
+                        continue;
+                    }
+
+                    // Use the time stamp of the kernel if there is one; fall back to the time of reading.
+                    std::chrono::system_clock::time_point timestamp{now};
+                    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header); nullptr != cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+                        if ((SOL_SOCKET == cmsg->cmsg_level) && (SCM_TIMESTAMPNS == cmsg->cmsg_type)) {
+                            struct timespec receivedTimeStamp {};
+                            std::memcpy(&receivedTimeStamp, CMSG_DATA(cmsg), sizeof(receivedTimeStamp)); /* Flawfinder: ignore */ // NOLINT
+                            timestamp = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                std::chrono::seconds(receivedTimeStamp.tv_sec) + std::chrono::nanoseconds(receivedTimeStamp.tv_nsec)));
+                        }
+                    }
+
+                    hasQueued |= enqueue(static_cast<const char *>(header.msg_iov->iov_base),
+                                         m_messages[static_cast<std::size_t>(i)].msg_len,
+                                         m_remotes[static_cast<std::size_t>(i)],
+                                         timestamp);
+                }
+                // A full batch means that more datagrams may be waiting.
+            } while (received == static_cast<int>(m_datagramsPerRead));
+        }
+
+        if (hasQueued) {
+            if (m_pipeline) {
+                m_pipeline->notifyAll();
+            }
+        }
+    }
+}
+#else
 inline void UDPReceiver::readFromSocket() noexcept {
     // Create buffer to store data from socket.
     constexpr uint16_t MAX_LENGTH = static_cast<uint16_t>(UDPPacketSizeConstraints::MAX_SIZE_UDP_PACKET)
@@ -10475,10 +11087,6 @@ inline void UDPReceiver::readFromSocket() noexcept {
     // Define file descriptor set to watch for read operations.
     fd_set setOfFiledescriptorsToReadFrom{};
 
-    // Sender address and port.
-    constexpr uint16_t MAX_ADDR_SIZE{1024};
-    std::array<char, MAX_ADDR_SIZE> remoteAddress{};
-
     struct sockaddr_storage remote {};
     socklen_t addrLength{sizeof(remote)};
 
@@ -10496,7 +11104,7 @@ inline void UDPReceiver::readFromSocket() noexcept {
         FD_SET(m_socket, &setOfFiledescriptorsToReadFrom); // NOLINT
         ::select(m_socket + 1, &setOfFiledescriptorsToReadFrom, nullptr, nullptr, &timeout);
 
-        ssize_t totalBytesRead{0};
+        bool hasQueued{false};
         if (FD_ISSET(m_socket, &setOfFiledescriptorsToReadFrom)) { // NOLINT
             ssize_t bytesRead{0};
             do {
@@ -10508,62 +11116,19 @@ inline void UDPReceiver::readFromSocket() noexcept {
                                        reinterpret_cast<socklen_t *>(&addrLength));  // NOLINT
 
                 if ((0 < bytesRead) && (nullptr != m_delegate)) {
-#ifdef __linux__
-                    std::chrono::system_clock::time_point timestamp;
-                    struct timeval receivedTimeStamp {};
-                    if (0 == ::ioctl(m_socket, SIOCGSTAMP, &receivedTimeStamp)) { // NOLINT
-                        // Transform struct timeval to C++ chrono.
-                        std::chrono::time_point<std::chrono::system_clock, std::chrono::microseconds> transformedTimePoint(
-                            std::chrono::microseconds(receivedTimeStamp.tv_sec * 1000000L + receivedTimeStamp.tv_usec));
-                        timestamp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(transformedTimePoint);
-                    } else { // LCOV_EXCL_LINE
-                        // In case the ioctl failed, fall back to chrono. // LCOV_EXCL_LINE
-                        timestamp = std::chrono::system_clock::now(); // LCOV_EXCL_LINE
-                    }
-#else
-                    std::chrono::system_clock::time_point timestamp = std::chrono::system_clock::now();
-#endif
-
-                    // Transform sender address to C-string.
-                    ::inet_ntop(remote.ss_family,
-                                &((reinterpret_cast<struct sockaddr_in *>(&remote))->sin_addr), // NOLINT
-                                remoteAddress.data(),
-                                remoteAddress.max_size());
-                    const unsigned long RECVFROM_IP{reinterpret_cast<struct sockaddr_in *>(&remote)->sin_addr.s_addr}; // NOLINT
-                    const uint16_t RECVFROM_PORT{ntohs(reinterpret_cast<struct sockaddr_in *>(&remote)->sin_port)};    // NOLINT
-
-                    // Check if the bytes actually came from us.
-                    bool sentFromUs{false};
-                    {
-                        auto pos                   = m_listOfLocalIPAddresses.find(RECVFROM_IP);
-                        const bool sentFromLocalIP = (pos != m_listOfLocalIPAddresses.end() && (*pos == RECVFROM_IP));
-                        sentFromUs                 = sentFromLocalIP && (m_localSendFromPort == RECVFROM_PORT);
-                    }
-
-                    // Create a pipeline entry to be processed concurrently.
-                    if (!sentFromUs) {
-                        PipelineEntry pe;
-                        pe.m_data       = std::string(buffer.data(), static_cast<size_t>(bytesRead));
-                        pe.m_from       = std::string(remoteAddress.data()) + ':' + std::to_string(RECVFROM_PORT);
-                        pe.m_sampleTime = timestamp;
-
-                        // Store entry in queue.
-                        if (m_pipeline) {
-                            m_pipeline->add(std::move(pe));
-                        }
-                    }
-                    totalBytesRead += bytesRead;
+                    hasQueued |= enqueue(buffer.data(), static_cast<std::size_t>(bytesRead), remote, std::chrono::system_clock::now());
                 }
             } while (!m_isBlockingSocket && (bytesRead > 0));
         }
 
-        if (static_cast<int32_t>(totalBytesRead) > 0) {
+        if (hasQueued) {
             if (m_pipeline) {
                 m_pipeline->notifyAll();
             }
         }
     }
 }
+#endif
 } // namespace cluon
 /*
  * Copyright (C) 2017-2018  Christian Berger
@@ -10724,6 +11289,7 @@ inline void TCPConnection::startReadingFromSocket() noexcept {
     }
 
     try {
+        // Bytes of a stream must not be dropped; add() waits while the pipeline is full.
         m_pipeline = std::make_shared<cluon::NotifyingPipeline<PipelineEntry>>(
             [this](PipelineEntry &&entry) { this->m_newDataDelegate(std::move(entry.m_data), std::move(entry.m_sampleTime)); });
         if (m_pipeline) {
@@ -13940,19 +14506,28 @@ inline void ToMsgPackVisitor::visit(uint32_t id, std::string &&typeName, std::st
 
 namespace cluon {
 
-inline OD4Session::OD4Session(uint16_t CID, std::function<void(cluon::data::Envelope &&envelope)> delegate) noexcept
+inline OD4Session::OD4Session(uint16_t CID,
+                              std::function<void(cluon::data::Envelope &&envelope)> delegate,
+                              int32_t receiveBufferSize,
+                              std::size_t pipelineCapacity,
+                              NotifyingPipelineBase::OverflowPolicy overflowPolicy) noexcept
     : m_receiver{nullptr}
     , m_sender{"225.0.0." + std::to_string(CID), 12175}
     , m_delegate(std::move(delegate))
     , m_mapOfDataTriggeredDelegatesMutex{}
-    , m_mapOfDataTriggeredDelegates{} {
+    , m_mapOfDataTriggeredDelegates{}
+    , m_retiredMapsOfDataTriggeredDelegates{} {
     m_receiver = std::make_unique<cluon::UDPReceiver>(
         "225.0.0." + std::to_string(CID),
         12175,
         [this](std::string &&data, std::string &&from, std::chrono::system_clock::time_point &&timepoint) {
             this->callback(std::move(data), std::move(from), std::move(timepoint));
         },
-        m_sender.getSendFromPort() /* passing our local send from port to the UDPReceiver to filter out our own bytes */);
+        m_sender.getSendFromPort() /* passing our local send from port to the UDPReceiver to filter out our own bytes */,
+        receiveBufferSize,
+        uint16_t{UDPReceiver::DEFAULT_DATAGRAMS_PER_READ},
+        pipelineCapacity,
+        overflowPolicy);
 }
 
 inline void OD4Session::timeTrigger(float freq, std::function<bool()> delegate) noexcept {
@@ -13984,18 +14559,35 @@ inline void OD4Session::timeTrigger(float freq, std::function<bool()> delegate)
     }
 }
 
+inline OD4Session::~OD4Session() noexcept {
+    // Stop receiving before the tables of delegates go away.
+    m_receiver.reset();
+}
+
 inline bool OD4Session::dataTrigger(int32_t messageIdentifier, std::function<void(cluon::data::Envelope &&envelope)> delegate) noexcept {
     bool retVal{false};
     if (nullptr == m_delegate) {
         try {
             std::lock_guard<std::mutex> lck{m_mapOfDataTriggeredDelegatesMutex};
-            if ((nullptr == delegate) && (m_mapOfDataTriggeredDelegates.count(messageIdentifier) > 0)) {
-                auto element = m_mapOfDataTriggeredDelegates.find(messageIdentifier);
-                if (element != m_mapOfDataTriggeredDelegates.end()) {
-                    m_mapOfDataTriggeredDelegates.erase(element);
-                }
+            std::unique_ptr<DataTriggeredDelegates> next{m_mapOfDataTriggeredDelegates ? new DataTriggeredDelegates(*m_mapOfDataTriggeredDelegates)
+                                                                                       : new DataTriggeredDelegates()};
+            if (nullptr == delegate) {
+                next->erase(messageIdentifier);
             } else {
-                m_mapOfDataTriggeredDelegates[messageIdentifier] = delegate;
+                (*next)[messageIdentifier] = delegate;
+            }
+
+            // Publish the new version; callbacks that started before may still use the previous one.
+            m_retiredMapsOfDataTriggeredDelegates.reserve(m_retiredMapsOfDataTriggeredDelegates.size() + 1);
+            m_dataTriggeredDelegates.store(next.get());
+            if (m_mapOfDataTriggeredDelegates) {
+                m_retiredMapsOfDataTriggeredDelegates.emplace_back(std::move(m_mapOfDataTriggeredDelegates));
+            }
+            m_mapOfDataTriggeredDelegates = std::move(next);
+
+            // A callback that starts from now on sees the new version.
+            if (0 == m_callbacksInFlight.load()) {
+                m_retiredMapsOfDataTriggeredDelegates.clear();
             }
             retVal = true;
         } catch (...) {} // LCOV_EXCL_LINE
@@ -14003,21 +14595,61 @@ inline bool OD4Session::dataTrigger(int32_t messageIdentifier, std::function<voi
     return retVal;
 }
 
+inline OD4Session::EnvelopeCounterSlot *OD4Session::envelopeCounterSlot(int32_t dataType) noexcept {
+    static_assert(0 == (MAX_COUNTED_DATA_TYPES & (MAX_COUNTED_DATA_TYPES - 1)), "MAX_COUNTED_DATA_TYPES must be a power of two.");
+    const std::size_t MASK{MAX_COUNTED_DATA_TYPES - 1};
+    std::size_t index{(static_cast<uint32_t>(dataType) * 2654435761u) & MASK};
+    for (std::size_t probe{0}; probe < MAX_COUNTED_DATA_TYPES; probe++, index = (index + 1) & MASK) {
+        EnvelopeCounterSlot &slot = m_envelopeCounters[index];
+        uint8_t state{slot.state.load(std::memory_order_acquire)};
+        if (0 == state) {
+            if (slot.state.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+                slot.dataType = dataType;
+                slot.state.store(2, std::memory_order_release);
+                return &slot;
+            }
+        }
+        // Another thread is claiming this slot; its dataType is set right after.
+        while (1 == state) {
+            state = slot.state.load(std::memory_order_acquire);
+        }
+        if (dataType == slot.dataType) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
 inline void OD4Session::callback(std::string &&data, std::string && /*from*/, std::chrono::system_clock::time_point &&timepoint) noexcept {
-    size_t numberOfDataTriggeredDelegates{0};
-    {
-        try {
-            std::lock_guard<std::mutex> lck{m_mapOfDataTriggeredDelegatesMutex};
-            numberOfDataTriggeredDelegates = m_mapOfDataTriggeredDelegates.size();
-        } catch (...) {} // LCOV_EXCL_LINE
+    // Read only the dataType first to drop Envelopes nobody waits for before decoding them.
+    int32_t dataType{0};
+    if (!peekDataType(data.data(), data.size(), dataType)) {
+        return;
+    }
+
+    // No lock on this path: the current table of delegates is immutable while this callback runs.
+    m_callbacksInFlight.fetch_add(1);
+    const DataTriggeredDelegates *delegates{m_dataTriggeredDelegates.load()};
+    const std::function<void(cluon::data::Envelope &&envelope)> *dataTriggeredDelegate{nullptr};
+    if ((nullptr == m_delegate) && (nullptr != delegates)) {
+        auto element = delegates->find(dataType);
+        if (element != delegates->end()) {
+            dataTriggeredDelegate = &(element->second);
+        }
+    }
+    const bool isWanted{(nullptr != m_delegate) || (nullptr != dataTriggeredDelegate)};
+
+    EnvelopeCounterSlot *counters{envelopeCounterSlot(dataType)};
+    if (nullptr != counters) {
+        (isWanted ? counters->decoded : counters->skipped).fetch_add(1, std::memory_order_relaxed);
     }
-    // Only unpack the envelope when it needs to be post-processed.
-    if ((nullptr != m_delegate) || (0 < numberOfDataTriggeredDelegates)) {
-        std::stringstream sstr(data);
-        auto retVal = extractEnvelope(sstr);
+
+    if (isWanted) {
+        // Decode in place; only the payload is copied into the Envelope for the delegates.
+        auto retVal = extractEnvelope(data.data(), data.size());
 
         if (retVal.first) {
-            cluon::data::Envelope env{retVal.second};
+            cluon::data::Envelope env{retVal.second.toEnvelope()};
             env.received(cluon::time::convert(timepoint));
 
             // "Catch all"-delegate.
@@ -14026,14 +14658,30 @@ inline void OD4Session::callback(std::string &&data, std::string && /*from*/, st
             } else {
                 try {
                     // Data triggered-delegates.
-                    std::lock_guard<std::mutex> lck{m_mapOfDataTriggeredDelegatesMutex};
-                    if (m_mapOfDataTriggeredDelegates.count(env.dataType()) > 0) {
-                        m_mapOfDataTriggeredDelegates[env.dataType()](std::move(env));
-                    }
+                    (*dataTriggeredDelegate)(std::move(env));
                 } catch (...) {} // LCOV_EXCL_LINE
             }
         }
     }
+    m_callbacksInFlight.fetch_sub(1);
+}
+
+inline std::map<int32_t, OD4Session::EnvelopeCounters> OD4Session::envelopeCounters() noexcept {
+    std::map<int32_t, EnvelopeCounters> retVal;
+    try {
+        for (const EnvelopeCounterSlot &slot : m_envelopeCounters) {
+            if (2 == slot.state.load(std::memory_order_acquire)) {
+                EnvelopeCounters &counters = retVal[slot.dataType];
+                counters.decoded           = slot.decoded.load(std::memory_order_relaxed);
+                counters.skipped           = slot.skipped.load(std::memory_order_relaxed);
+            }
+        }
+    } catch (...) {} // LCOV_EXCL_LINE
+    return retVal;
+}
+
+inline NotifyingPipelineBase::Statistics OD4Session::pipelineStatistics() noexcept {
+    return m_receiver ? m_receiver->pipelineStatistics() : NotifyingPipelineBase::Statistics{};
 }
 
 inline void OD4Session::send(cluon::data::Envelope &&envelope) noexcept {
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONE_BLOB_EXTRACTOR_HPP
+#define CONE_BLOB_EXTRACTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// A connected region of non-zero mask pixels.
+struct ConeBlob
+{
+    float cx;
+    float cy;
+    uint32_t area;
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+};
+
+// Run-length encoded connected components (8-connectivity) that returns the
+// centroid, area and bounding box of every blob in one pass over the mask.
+// Runs of one row are only compared with the overlapping runs of the row
+// above and merged with a union-find, so the cost grows with the number of
+// runs rather than with the number of pixels or blobs.
+// All buffers are kept between calls; once they have grown to the largest
+// frame seen, extract() does not allocate.
+class ConeBlobExtractor
+{
+  public:
+    ConeBlobExtractor(uint32_t minArea = 1, uint32_t maxArea = std::numeric_limits<uint32_t>::max())
+        : m_minArea(minArea)
+        , m_maxArea(maxArea)
+    {
+    }
+
+    // Preallocates for the worst case of a width x height mask.
+    void reserve(uint32_t width, uint32_t height)
+    {
+        const std::size_t maxRuns = static_cast<std::size_t>(height) * ((width + 1) / 2);
+        m_runs.reserve(maxRuns);
+        m_rowStart.reserve(height + 1);
+        m_sums.reserve(maxRuns);
+        m_blobs.reserve(maxRuns);
+    }
+
+    // Blobs of non-zero pixels in the 8-bit mask whose area is within [minArea, maxArea].
+    const std::vector<ConeBlob> &extract(const uint8_t *mask, std::size_t step, uint32_t width, uint32_t height)
+    {
+        m_runs.clear();
+        m_rowStart.clear();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t *row = mask + y * step;
+            beginRow(y);
+            uint32_t x = 0;
+            while (x < width)
+            {
+                while ((x < width) && (0 == row[x]))
+                {
+                    x++;
+                }
+                const uint32_t x0 = x;
+                while ((x < width) && (0 != row[x]))
+                {
+                    x++;
+                }
+                if (x0 < x)
+                {
+                    addRun(y, x0, x);
+                }
+            }
+        }
+        m_rowStart.push_back(static_cast<uint32_t>(m_runs.size()));
+        return collect();
+    }
+
+    // The same for a bit-packed mask with 64 pixels per word, lowest bit first (see PackedMask); bits past
+    // the width must be clear. Runs are found a word at a time by counting trailing zeros and ones.
+    const std::vector<ConeBlob> &extractPacked(const uint64_t *words, std::size_t wordStride, uint32_t width, uint32_t height)
+    {
+        const uint32_t wordCount = (width + 63) / 64;
+        m_runs.clear();
+        m_rowStart.clear();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint64_t *row = words + y * wordStride;
+            beginRow(y);
+            bool open = false;
+            uint32_t x0 = 0;
+            for (uint32_t w = 0; w < wordCount; w++)
+            {
+                // Bits that differ from their lower neighbour mark the starts and ends of runs
+                const uint64_t bits = row[w];
+                const uint64_t below = (bits << 1) | (open ? 1 : 0);
+                uint64_t edges = bits ^ below;
+                while (0 != edges)
+                {
+                    const uint32_t x = w * 64 + static_cast<uint32_t>(__builtin_ctzll(edges));
+                    if (open)
+                    {
+                        addRun(y, x0, x);
+                    }
+                    else
+                    {
+                        x0 = x;
+                    }
+                    open = !open;
+                    edges &= edges - 1;
+                }
+            }
+            if (open)
+            {
+                addRun(y, x0, wordCount * 64);
+            }
+        }
+        m_rowStart.push_back(static_cast<uint32_t>(m_runs.size()));
+        return collect();
+    }
+
+    const std::vector<ConeBlob> &blobs() const { return m_blobs; }
+
+    uint32_t minArea() const { return m_minArea; }
+    uint32_t maxArea() const { return m_maxArea; }
+
+  private:
+    struct Run
+    {
+        int32_t y;
+        int32_t x0;
+        int32_t x1; // exclusive
+        uint32_t parent;
+    };
+
+    void beginRow(uint32_t y)
+    {
+        m_rowStart.push_back(static_cast<uint32_t>(m_runs.size()));
+        m_above = (0 < y) ? m_rowStart[y - 1] : 0;
+    }
+
+    // Appends the run [x0, x1) of row y; runs must be added in ascending order.
+    void addRun(uint32_t y, uint32_t x0, uint32_t x1)
+    {
+        const uint32_t self = static_cast<uint32_t>(m_runs.size());
+        m_runs.push_back(Run{static_cast<int32_t>(y), static_cast<int32_t>(x0), static_cast<int32_t>(x1), self});
+        if (0 == y)
+        {
+            return;
+        }
+
+        // Runs of the previous row that touch [x0 - 1, x1] (8-connectivity).
+        // Runs ending left of x0 cannot touch any later run of this row either.
+        const uint32_t end = m_rowStart[y];
+        while ((m_above < end) && (m_runs[m_above].x1 < static_cast<int32_t>(x0)))
+        {
+            m_above++;
+        }
+        for (uint32_t i = m_above; i < end; i++)
+        {
+            const Run &above = m_runs[i];
+            if (above.x0 > static_cast<int32_t>(x1))
+            {
+                break;
+            }
+            if (above.x1 >= static_cast<int32_t>(x0))
+            {
+                unite(i, self);
+            }
+        }
+    }
+
+    const std::vector<ConeBlob> &collect()
+    {
+        m_blobs.clear();
+        const uint32_t runCount = static_cast<uint32_t>(m_runs.size());
+
+        // Accumulate the statistics at the root run of every component; the
+        // root always comes first as unite() keeps the smaller index.
+        m_sums.resize(runCount);
+        for (uint32_t i = 0; i < runCount; i++)
+        {
+            Run &run = m_runs[i];
+            const uint32_t root = find(i);
+            run.parent = root;
+
+            const uint64_t length = static_cast<uint64_t>(run.x1 - run.x0);
+            const uint64_t sumX = (static_cast<uint64_t>(run.x0) + static_cast<uint64_t>(run.x1 - 1)) * length / 2;
+            Sums &sums = m_sums[root];
+            if (root == i)
+            {
+                sums = Sums{0, 0, 0, run.x0, run.y, run.x1 - 1, run.y};
+            }
+            sums.area += length;
+            sums.sumX += sumX;
+            sums.sumY += length * static_cast<uint64_t>(run.y);
+            sums.minX = std::min(sums.minX, run.x0);
+            sums.maxX = std::max(sums.maxX, run.x1 - 1);
+            sums.maxY = std::max(sums.maxY, run.y);
+        }
+
+        for (uint32_t i = 0; i < runCount; i++)
+        {
+            if (m_runs[i].parent != i)
+            {
+                continue;
+            }
+            const Sums &sums = m_sums[i];
+            if ((sums.area < m_minArea) || (sums.area > m_maxArea))
+            {
+                continue;
+            }
+            const double area = static_cast<double>(sums.area);
+            m_blobs.push_back(ConeBlob{static_cast<float>(static_cast<double>(sums.sumX) / area),
+                                       static_cast<float>(static_cast<double>(sums.sumY) / area),
+                                       static_cast<uint32_t>(sums.area),
+                                       sums.minX, sums.minY, sums.maxX, sums.maxY});
+        }
+        return m_blobs;
+    }
+
+    uint32_t find(uint32_t i)
+    {
+        while (m_runs[i].parent != i)
+        {
+            m_runs[i].parent = m_runs[m_runs[i].parent].parent;
+            i = m_runs[i].parent;
+        }
+        return i;
+    }
+
+    void unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a < b)
+        {
+            m_runs[b].parent = a;
+        }
+        else if (b < a)
+        {
+            m_runs[a].parent = b;
+        }
+    }
+
+  private:
+    struct Sums
+    {
+        uint64_t area;
+        uint64_t sumX;
+        uint64_t sumY;
+        int32_t minX;
+        int32_t minY;
+        int32_t maxX;
+        int32_t maxY;
+    };
+
+    uint32_t m_minArea;
+    uint32_t m_maxArea;
+    std::vector<Run> m_runs{};
+    std::vector<uint32_t> m_rowStart{};
+    uint32_t m_above{0};
+    std::vector<Sums> m_sums{};
+    std::vector<ConeBlob> m_blobs{};
+};
+
+#endif
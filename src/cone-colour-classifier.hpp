@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONE_COLOUR_CLASSIFIER_HPP
+#define CONE_COLOUR_CLASSIFIER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONE_COLOUR_CLASSIFIER_X86 1
+#endif
+
+// Inclusive HSV box as used by cv::inRange (H in [0, 180), S and V in [0, 255]).
+struct HsvRange
+{
+    int32_t minH;
+    int32_t maxH;
+    int32_t minS;
+    int32_t maxS;
+    int32_t minV;
+    int32_t maxV;
+
+    bool contains(int32_t h, int32_t s, int32_t v) const
+    {
+        return (minH <= h) && (h <= maxH) && (minS <= s) && (s <= maxS) && (minV <= v) && (v <= maxV);
+    }
+};
+
+// The colour thresholds that were tuned on the recordings for yellow cones,
+// blue cones and the large reflections that show up in the blue range.
+struct ConeThresholds
+{
+    HsvRange yellow{6, 30, 51, 235, 75, 255};
+    HsvRange blue{106, 155, 59, 255, 29, 255};
+    HsvRange blueReflection{121, 179, 0, 98, 0, 255};
+};
+
+// Common interface of the colour classifiers: turns a BGRA image into the
+// yellow mask and the blue-minus-reflection mask (0 or 255 per pixel).
+class ConeClassifier
+{
+  public:
+    virtual ~ConeClassifier() = default;
+
+    virtual void classify(const uint8_t *bgra, std::size_t bgraStep, uint32_t width, uint32_t height,
+                          uint8_t *yellow, std::size_t yellowStep, uint8_t *blue, std::size_t blueStep) const = 0;
+};
+
+// Single-pass classifier that turns a BGRA crop into the yellow mask and the
+// blue-minus-reflection mask. The HSV conversion reproduces OpenCV's 8-bit
+// CV_BGR2HSV fixed-point arithmetic (including its division tables), so the
+// masks are identical to cvtColor + inRange + bitwise_and + bitwise_xor.
+// On x86 an AVX2 or SSE4.1 kernel is picked at runtime; other targets (arm/v7)
+// use the scalar kernel.
+class ConeColourClassifier : public ConeClassifier
+{
+  public:
+    enum class Kernel
+    {
+        Scalar,
+        SSE41,
+        AVX2
+    };
+
+    explicit ConeColourClassifier(const ConeThresholds &thresholds = ConeThresholds{})
+        : m_thresholds(thresholds)
+    {
+        m_sdiv[0] = m_hdiv[0] = 0;
+        for (int32_t i = 1; i < 256; i++)
+        {
+            m_sdiv[static_cast<std::size_t>(i)] = static_cast<int32_t>(std::lround((255 << HSV_SHIFT) / (1.0 * i)));
+            m_hdiv[static_cast<std::size_t>(i)] = static_cast<int32_t>(std::lround((180 << HSV_SHIFT) / (6.0 * i)));
+        }
+        for (uint32_t m = 0; m < 256; m++)
+        {
+            uint64_t bytes = 0;
+            for (uint32_t bit = 0; bit < 8; bit++)
+            {
+                if (m & (1u << bit))
+                {
+                    bytes |= static_cast<uint64_t>(0xFF) << (8 * bit);
+                }
+            }
+            m_expand[m] = bytes;
+        }
+
+#ifdef CONE_COLOUR_CLASSIFIER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            m_kernel = Kernel::AVX2;
+        }
+        else if (__builtin_cpu_supports("sse4.1"))
+        {
+            m_kernel = Kernel::SSE41;
+        }
+#endif
+    }
+
+    const ConeThresholds &thresholds() const { return m_thresholds; }
+
+    Kernel kernel() const { return m_kernel; }
+
+    // Restricts the classifier to a slower kernel, e.g. for comparisons.
+    void forceKernel(Kernel kernel)
+    {
+        if (kernel < m_kernel)
+        {
+            m_kernel = kernel;
+        }
+    }
+
+    // OpenCV's 8-bit BGR to HSV conversion for a single pixel.
+    void toHsv(int32_t b, int32_t g, int32_t r, int32_t &h, int32_t &s, int32_t &v) const
+    {
+        v = std::max(b, std::max(g, r));
+        const int32_t vmin = std::min(b, std::min(g, r));
+        const int32_t diff = v - vmin;
+        const int32_t vr = (v == r) ? -1 : 0;
+        const int32_t vg = (v == g) ? -1 : 0;
+
+        s = (diff * m_sdiv[static_cast<std::size_t>(v)] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+        h = (h * m_hdiv[static_cast<std::size_t>(diff)] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        h += (h < 0) ? 180 : 0;
+        h = std::min(std::max(h, 0), 255);
+    }
+
+    // Classifies a single pixel; returns true for the yellow or blue class respectively.
+    void classifyPixel(int32_t b, int32_t g, int32_t r, bool &isYellow, bool &isBlue) const
+    {
+        int32_t h, s, v;
+        toHsv(b, g, r, h, s, v);
+        isYellow = m_thresholds.yellow.contains(h, s, v);
+        isBlue = m_thresholds.blue.contains(h, s, v) && !m_thresholds.blueReflection.contains(h, s, v);
+    }
+
+    // Reads the BGRA image once and writes both 8-bit masks (0 or 255).
+    void classify(const uint8_t *bgra, std::size_t bgraStep, uint32_t width, uint32_t height,
+                  uint8_t *yellow, std::size_t yellowStep, uint8_t *blue, std::size_t blueStep) const override
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t *src = bgra + y * bgraStep;
+            uint8_t *dstY = yellow + y * yellowStep;
+            uint8_t *dstB = blue + y * blueStep;
+            uint32_t x = 0;
+#ifdef CONE_COLOUR_CLASSIFIER_X86
+            if (Kernel::AVX2 == m_kernel)
+            {
+                x = classifyRowAvx2(src, width, dstY, dstB);
+            }
+            else if (Kernel::SSE41 == m_kernel)
+            {
+                x = classifyRowSse41(src, width, dstY, dstB);
+            }
+#endif
+            classifyRowScalar(src, x, width, dstY, dstB);
+        }
+    }
+
+  private:
+    static constexpr int32_t HSV_SHIFT = 12;
+
+    void classifyRowScalar(const uint8_t *src, uint32_t x, uint32_t width, uint8_t *dstY, uint8_t *dstB) const
+    {
+        for (; x < width; x++)
+        {
+            const uint8_t *px = src + 4 * x;
+            bool isYellow, isBlue;
+            classifyPixel(px[0], px[1], px[2], isYellow, isBlue);
+            dstY[x] = isYellow ? 255 : 0;
+            dstB[x] = isBlue ? 255 : 0;
+        }
+    }
+
+#ifdef CONE_COLOUR_CLASSIFIER_X86
+    __attribute__((target("avx2"))) static __m256i inRangeAvx2(__m256i x, int32_t lo, int32_t hi)
+    {
+        const __m256i below = _mm256_cmpgt_epi32(_mm256_set1_epi32(lo), x);
+        const __m256i above = _mm256_cmpgt_epi32(x, _mm256_set1_epi32(hi));
+        return _mm256_andnot_si256(_mm256_or_si256(below, above), _mm256_set1_epi32(-1));
+    }
+
+    __attribute__((target("avx2"))) static __m256i inBoxAvx2(__m256i h, __m256i s, __m256i v, const HsvRange &r)
+    {
+        return _mm256_and_si256(inRangeAvx2(h, r.minH, r.maxH),
+                                _mm256_and_si256(inRangeAvx2(s, r.minS, r.maxS), inRangeAvx2(v, r.minV, r.maxV)));
+    }
+
+    // Eight pixels per iteration in 32-bit lanes; the division tables are gathered.
+    __attribute__((target("avx2"))) uint32_t classifyRowAvx2(const uint8_t *src, uint32_t width, uint8_t *dstY, uint8_t *dstB) const
+    {
+        const __m256i byteMask = _mm256_set1_epi32(0xFF);
+        const __m256i round = _mm256_set1_epi32(1 << (HSV_SHIFT - 1));
+        const __m256i hueRange = _mm256_set1_epi32(180);
+        const __m256i zero = _mm256_setzero_si256();
+
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 4 * x));
+            const __m256i b = _mm256_and_si256(px, byteMask);
+            const __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask);
+            const __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask);
+
+            const __m256i v = _mm256_max_epi32(b, _mm256_max_epi32(g, r));
+            const __m256i vmin = _mm256_min_epi32(b, _mm256_min_epi32(g, r));
+            const __m256i diff = _mm256_sub_epi32(v, vmin);
+            const __m256i vr = _mm256_cmpeq_epi32(v, r);
+            const __m256i vg = _mm256_cmpeq_epi32(v, g);
+
+            const __m256i sdiv = _mm256_i32gather_epi32(m_sdiv.data(), v, 4);
+            const __m256i s = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), round), HSV_SHIFT);
+
+            const __m256i diff2 = _mm256_add_epi32(diff, diff);
+            const __m256i hR = _mm256_sub_epi32(g, b);
+            const __m256i hG = _mm256_add_epi32(_mm256_sub_epi32(b, r), diff2);
+            const __m256i hB = _mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_add_epi32(diff2, diff2));
+            __m256i h = _mm256_add_epi32(_mm256_and_si256(vr, hR),
+                                         _mm256_andnot_si256(vr, _mm256_add_epi32(_mm256_and_si256(vg, hG), _mm256_andnot_si256(vg, hB))));
+            const __m256i hdiv = _mm256_i32gather_epi32(m_hdiv.data(), diff, 4);
+            h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h, hdiv), round), HSV_SHIFT);
+            h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(zero, h), hueRange));
+
+            const __m256i isYellow = inBoxAvx2(h, s, v, m_thresholds.yellow);
+            const __m256i isBlue = _mm256_andnot_si256(inBoxAvx2(h, s, v, m_thresholds.blueReflection),
+                                                       inBoxAvx2(h, s, v, m_thresholds.blue));
+
+            const uint64_t maskY = m_expand[static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(isYellow)))];
+            const uint64_t maskB = m_expand[static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(isBlue)))];
+            std::memcpy(dstY + x, &maskY, sizeof(maskY));
+            std::memcpy(dstB + x, &maskB, sizeof(maskB));
+        }
+        return x;
+    }
+
+    __attribute__((target("sse4.1"))) static __m128i inRangeSse41(__m128i x, int32_t lo, int32_t hi)
+    {
+        const __m128i below = _mm_cmpgt_epi32(_mm_set1_epi32(lo), x);
+        const __m128i above = _mm_cmpgt_epi32(x, _mm_set1_epi32(hi));
+        return _mm_andnot_si128(_mm_or_si128(below, above), _mm_set1_epi32(-1));
+    }
+
+    __attribute__((target("sse4.1"))) static __m128i inBoxSse41(__m128i h, __m128i s, __m128i v, const HsvRange &r)
+    {
+        return _mm_and_si128(inRangeSse41(h, r.minH, r.maxH),
+                             _mm_and_si128(inRangeSse41(s, r.minS, r.maxS), inRangeSse41(v, r.minV, r.maxV)));
+    }
+
+    // Four pixels per iteration; without gathers the table lookups are done per lane.
+    __attribute__((target("sse4.1"))) uint32_t classifyRowSse41(const uint8_t *src, uint32_t width, uint8_t *dstY, uint8_t *dstB) const
+    {
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        const __m128i round = _mm_set1_epi32(1 << (HSV_SHIFT - 1));
+        const __m128i hueRange = _mm_set1_epi32(180);
+        const __m128i zero = _mm_setzero_si128();
+
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * x));
+            const __m128i b = _mm_and_si128(px, byteMask);
+            const __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), byteMask);
+            const __m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), byteMask);
+
+            const __m128i v = _mm_max_epi32(b, _mm_max_epi32(g, r));
+            const __m128i vmin = _mm_min_epi32(b, _mm_min_epi32(g, r));
+            const __m128i diff = _mm_sub_epi32(v, vmin);
+            const __m128i vr = _mm_cmpeq_epi32(v, r);
+            const __m128i vg = _mm_cmpeq_epi32(v, g);
+
+            const __m128i sdiv = _mm_setr_epi32(m_sdiv[static_cast<uint32_t>(_mm_extract_epi32(v, 0))],
+                                                m_sdiv[static_cast<uint32_t>(_mm_extract_epi32(v, 1))],
+                                                m_sdiv[static_cast<uint32_t>(_mm_extract_epi32(v, 2))],
+                                                m_sdiv[static_cast<uint32_t>(_mm_extract_epi32(v, 3))]);
+            const __m128i s = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(diff, sdiv), round), HSV_SHIFT);
+
+            const __m128i diff2 = _mm_add_epi32(diff, diff);
+            const __m128i hR = _mm_sub_epi32(g, b);
+            const __m128i hG = _mm_add_epi32(_mm_sub_epi32(b, r), diff2);
+            const __m128i hB = _mm_add_epi32(_mm_sub_epi32(r, g), _mm_add_epi32(diff2, diff2));
+            __m128i h = _mm_add_epi32(_mm_and_si128(vr, hR),
+                                      _mm_andnot_si128(vr, _mm_add_epi32(_mm_and_si128(vg, hG), _mm_andnot_si128(vg, hB))));
+            const __m128i hdiv = _mm_setr_epi32(m_hdiv[static_cast<uint32_t>(_mm_extract_epi32(diff, 0))],
+                                                m_hdiv[static_cast<uint32_t>(_mm_extract_epi32(diff, 1))],
+                                                m_hdiv[static_cast<uint32_t>(_mm_extract_epi32(diff, 2))],
+                                                m_hdiv[static_cast<uint32_t>(_mm_extract_epi32(diff, 3))]);
+            h = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(h, hdiv), round), HSV_SHIFT);
+            h = _mm_add_epi32(h, _mm_and_si128(_mm_cmpgt_epi32(zero, h), hueRange));
+
+            const __m128i isYellow = inBoxSse41(h, s, v, m_thresholds.yellow);
+            const __m128i isBlue = _mm_andnot_si128(inBoxSse41(h, s, v, m_thresholds.blueReflection),
+                                                    inBoxSse41(h, s, v, m_thresholds.blue));
+
+            const uint32_t maskY = static_cast<uint32_t>(m_expand[static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(isYellow)))]);
+            const uint32_t maskB = static_cast<uint32_t>(m_expand[static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(isBlue)))]);
+            std::memcpy(dstY + x, &maskY, sizeof(maskY));
+            std::memcpy(dstB + x, &maskB, sizeof(maskB));
+        }
+        return x;
+    }
+#endif
+
+  private:
+    ConeThresholds m_thresholds;
+    Kernel m_kernel{Kernel::Scalar};
+    std::array<int32_t, 256> m_sdiv{};
+    std::array<int32_t, 256> m_hdiv{};
+    // Expands an 8-bit lane mask into eight 0x00/0xFF bytes.
+    std::array<uint64_t, 256> m_expand{};
+};
+
+// Lookup table from quantised BGR straight to the cone class, so the hot loop
+// does no HSV conversion at all. The table is built once from an exact
+// classifier: every one of the 2^24 BGR values is classified and each cell
+// takes the class most of its members have. With 8 bits per channel the table
+// is exact (16 MiB), 6 bits need 256 KiB and 5 bits fit into 32 KiB.
+class ConeColourLut : public ConeClassifier
+{
+  public:
+    static bool isValidBits(int32_t bits) { return (5 == bits) || (6 == bits) || (8 == bits); }
+
+    ConeColourLut(const ConeColourClassifier &exact, uint32_t bits)
+        : m_bits(bits)
+        , m_shift(8 - bits)
+        , m_table(std::size_t{1} << (3 * bits), 0)
+    {
+        std::vector<uint8_t> plane(256 * 256 * 4, 0);
+        std::vector<uint8_t> yellow(256 * 256, 0);
+        std::vector<uint8_t> blue(256 * 256, 0);
+        for (uint32_t g = 0; g < 256; g++)
+        {
+            for (uint32_t b = 0; b < 256; b++)
+            {
+                uint8_t *px = &plane[4 * (g * 256 + b)];
+                px[0] = static_cast<uint8_t>(b);
+                px[1] = static_cast<uint8_t>(g);
+            }
+        }
+
+        // Votes for none/yellow/blue of the cells in one red slab only, i.e.
+        // 2^(2 * bits) cells of at most 2^9 colours each. The exact table
+        // needs no votes at all.
+        const uint32_t slabs = uint32_t{1} << bits;
+        const uint32_t planesPerSlab = uint32_t{1} << m_shift;
+        const std::size_t slabCells = std::size_t{1} << (2 * bits);
+        std::vector<uint16_t> votes((0 == m_shift) ? 0 : 3 * slabCells, 0);
+
+        uint64_t agreeing = 0;
+        for (uint32_t slab = 0; slab < slabs; slab++)
+        {
+            std::fill(votes.begin(), votes.end(), uint16_t{0});
+
+            // Classify one red plane at a time using the fast exact kernel.
+            for (uint32_t r = slab * planesPerSlab; r < (slab + 1) * planesPerSlab; r++)
+            {
+                for (std::size_t i = 0; i < 256 * 256; i++)
+                {
+                    plane[4 * i + 2] = static_cast<uint8_t>(r);
+                }
+                exact.classify(plane.data(), 256 * 256 * 4, 256 * 256, 1, yellow.data(), 256 * 256, blue.data(), 256 * 256);
+
+                for (uint32_t g = 0; g < 256; g++)
+                {
+                    for (uint32_t b = 0; b < 256; b++)
+                    {
+                        const uint32_t i = g * 256 + b;
+                        const uint8_t label = (0 != yellow[i]) ? YELLOW : ((0 != blue[i]) ? BLUE : NONE);
+                        if (0 == m_shift)
+                        {
+                            m_table[index(b, g, r)] = label;
+                        }
+                        else
+                        {
+                            votes[3 * (((b >> m_shift) << bits) | (g >> m_shift)) + label]++;
+                        }
+                    }
+                }
+            }
+            if (0 == m_shift)
+            {
+                agreeing += 256 * 256;
+                continue;
+            }
+
+            for (std::size_t cell = 0; cell < slabCells; cell++)
+            {
+                const uint16_t *v = &votes[3 * cell];
+                uint8_t label = NONE;
+                if ((v[YELLOW] > v[label]) && (v[YELLOW] >= v[BLUE]))
+                {
+                    label = YELLOW;
+                }
+                else if (v[BLUE] > v[label])
+                {
+                    label = BLUE;
+                }
+                m_table[(cell << bits) | slab] = label;
+                agreeing += v[label];
+            }
+        }
+        m_agreement = static_cast<double>(agreeing) / static_cast<double>(uint64_t{1} << 24);
+    }
+
+    uint32_t bits() const { return m_bits; }
+
+    std::size_t tableSize() const { return m_table.size(); }
+
+    // Fraction of all 2^24 BGR values that get the same class as the exact HSV path.
+    double agreement() const { return m_agreement; }
+
+    void classify(const uint8_t *bgra, std::size_t bgraStep, uint32_t width, uint32_t height,
+                  uint8_t *yellow, std::size_t yellowStep, uint8_t *blue, std::size_t blueStep) const override
+    {
+        const uint8_t *table = m_table.data();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t *src = bgra + y * bgraStep;
+            uint8_t *dstY = yellow + y * yellowStep;
+            uint8_t *dstB = blue + y * blueStep;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const uint8_t *px = src + 4 * x;
+                const uint8_t label = table[index(px[0], px[1], px[2])];
+                dstY[x] = static_cast<uint8_t>(-static_cast<int32_t>(label & YELLOW));
+                dstB[x] = static_cast<uint8_t>(-static_cast<int32_t>((label & BLUE) >> 1));
+            }
+        }
+    }
+
+  private:
+    static constexpr uint8_t NONE = 0;
+    static constexpr uint8_t YELLOW = 1;
+    static constexpr uint8_t BLUE = 2;
+
+    uint32_t index(uint32_t b, uint32_t g, uint32_t r) const
+    {
+        return ((b >> m_shift) << (2 * m_bits)) | ((g >> m_shift) << m_bits) | (r >> m_shift);
+    }
+
+  private:
+    uint32_t m_bits;
+    uint32_t m_shift;
+    std::vector<uint8_t> m_table;
+    double m_agreement{0.0};
+};
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONE_PIPELINE_HPP
+#define CONE_PIPELINE_HPP
+
+// The cone detection and steering code shared by the microservice and the
+// offline benchmark, so both always run exactly the same computation.
+
+#include "cone-colour-classifier.hpp"
+#include "cone-tracker.hpp"
+#include "frame-pipeline.hpp"
+#include "frame-workspace.hpp"
+#include "homography.hpp"
+#include "latency-histogram.hpp"
+#include "steering-geometry.hpp"
+#include "worker-pool.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The close perspective of the camera solved into the bird's-eye view at compile time.
+//
+// How the vertices should be mapped on the destination image
+//
+//    [0]   [1]
+//
+//    [2]   [3]
+//
+constexpr VertexPair CLOSE_PERSPECTIVE_VERTICES[4]{
+    {207, 285, 125, 130},
+    {364, 285, 390, 130},
+    {476, 350, 390, 395},
+    {89, 353, 125, 395},
+};
+constexpr Homography CLOSE_PERSPECTIVE{Homography::fromVertices(CLOSE_PERSPECTIVE_VERTICES)};
+static_assert(CLOSE_PERSPECTIVE.valid(), "the vertices of the close perspective must not be collinear");
+
+inline const Homography &getMatrix()
+{
+    return CLOSE_PERSPECTIVE;
+}
+
+inline void convertPoints(const Homography &M, const std::vector<cv::Point2f> &coordinates, std::vector<cv::Point2f> &dst_points)
+{
+
+    // Changing perspective to birds-eye view; the points stay within the capacity reserved for them
+    dst_points.resize(coordinates.size());
+    M.transform(coordinates.data(), dst_points.data(), coordinates.size());
+}
+
+// The two steering functions read the cones in place; see steering-geometry.hpp.
+inline double calculateAngleOfRoad(const std::vector<cv::Point2f> &cones_y_b){
+
+                    return angleOfRoad(cones_y_b.data(), cones_y_b.size());
+}
+
+inline double calculateSteeringAngle(const std::vector<cv::Point2f> &cones_y, const std::vector<cv::Point2f> &cones_b){
+
+                return steeringAngle(cones_y.data(), cones_y.size(), cones_b.data(), cones_b.size());
+}
+
+// Calls f with every part of the crop that is searched for cones in this frame, in crop coordinates.
+template <typename F>
+inline void forEachSearchArea(const FrameWorkspace &ws, F &&f){
+
+                // The near band, if any, is searched separately at reduced resolution
+                const cv::Rect farBand{0, 0, ws.crop.width, ws.farRows()};
+                if (ws.fullScan)
+                {
+                    if (0 < farBand.area())
+                    {
+                        f(farBand);
+                    }
+                }
+                else
+                {
+                    for (const cv::Rect &window : ws.searchWindows)
+                    {
+                        const cv::Rect area{window & farBand};
+                        if (0 < area.area())
+                        {
+                            f(area);
+                        }
+                    }
+                }
+
+}
+
+
+// Blobs with their mass centers in a single pass over the given area of the reduced mask, in area coordinates.
+inline const std::vector<ConeBlob> &extractBlobs(ConeChannel &channel, const cv::Rect &area){
+
+                const uint32_t width = static_cast<uint32_t>(area.width);
+                const uint32_t height = static_cast<uint32_t>(area.height);
+                if (!channel.packed)
+                {
+                    return channel.blobs.extract(channel.reduced.ptr<uint8_t>(area.y, area.x), channel.reduced.step, width, height);
+                }
+
+                // Rows that start at the left edge of the mask are read in place; other areas are moved to bit 0 first
+                PackedMask &reduced = channel.packedReduced;
+                if ((0 == area.x) && (reduced.width() == width))
+                {
+                    return channel.blobs.extractPacked(reduced.row(static_cast<uint32_t>(area.y)), reduced.stride(), width, height);
+                }
+                PackedMask &scratch = channel.packedScratch;
+                scratch.resize(width, height);
+                for (uint32_t y = 0; y < height; y++)
+                {
+                    PackedMask::copyBits(reduced.row(static_cast<uint32_t>(area.y) + y), static_cast<uint32_t>(area.x), scratch.row(y), 0, width);
+                }
+                scratch.setBorder(false);
+                return channel.blobs.extractPacked(scratch.row(0), scratch.stride(), width, height);
+
+}
+
+
+// Finds the cones of one colour as blobs in the given area of the reduced mask and appends their mass
+// centers in frame coordinates.
+inline void drawContours(ConeChannel &channel, int32_t roiTop, const cv::Rect &area){
+                const std::vector<ConeBlob> &blobs = extractBlobs(channel, area);
+
+                // Get the mass centers:
+                for (unsigned int i = 0; i < blobs.size(); i++)
+                {
+                    channel.mc.push_back(cv::Point2f(blobs[i].cx + static_cast<float>(area.x), blobs[i].cy + static_cast<float>(area.y + roiTop)));
+                }
+}
+
+
+// Finds the cones of one colour in the near band and appends their mass centers in full-resolution
+// frame coordinates.
+inline void drawNearContours(const NearBand &near, ConeChannel &nearChannel, ConeChannel &channel, int32_t roiTop){
+                const std::vector<ConeBlob> &blobs = extractBlobs(nearChannel, cv::Rect(0, 0, nearChannel.reduced.cols, nearChannel.reduced.rows));
+
+                // A reduced pixel covers scale x scale pixels of the frame; its center is mapped to theirs
+                const float scale = static_cast<float>(near.scale);
+                for (unsigned int i = 0; i < blobs.size(); i++)
+                {
+                    channel.mc.push_back(cv::Point2f((blobs[i].cx + 0.5f) * scale - 0.5f,
+                                                     (blobs[i].cy + 0.5f) * scale - 0.5f + static_cast<float>(near.top + roiTop)));
+                }
+}
+
+
+// Finds the cones of one colour in every searched area of the frame and in the near band.
+inline void drawContours(ConeChannel &channel, FrameWorkspace &ws){
+                channel.mc.clear();
+                forEachSearchArea(ws, [&channel, &ws](const cv::Rect &area) { drawContours(channel, ws.crop.y, area); });
+                if (ws.near)
+                {
+                    drawNearContours(*ws.near, (&channel == &ws.yellow) ? ws.near->yellow : ws.near->blue, channel, ws.crop.y);
+                }
+}
+
+
+// Moves the mass centers of one colour into the bird's-eye view; drawing is left to the BirdEyeRenderer.
+inline void transformCones(ConeChannel &channel, const Homography &M){
+                // Change the perspective of all mass centers at once
+                channel.cones.clear();
+                if (!channel.mc.empty())
+                {
+                    convertPoints(M, channel.mc, channel.cones);
+                }
+}
+
+
+// The same on the packed masks: the area is processed in the scratch mask and copied into the reduced one.
+inline void reducePackedImage(ConeChannel &channel, const cv::Rect &area){
+
+                const uint32_t width = static_cast<uint32_t>(area.width);
+                const uint32_t height = static_cast<uint32_t>(area.height);
+                const uint32_t x0 = static_cast<uint32_t>(area.x);
+                const uint32_t y0 = static_cast<uint32_t>(area.y);
+                PackedMask &scratch = channel.packedScratch;
+                scratch.resize(width, height);
+                for (uint32_t y = 0; y < height; y++)
+                {
+                    PackedMask::copyBits(channel.packedMasked.row(y0 + y), x0, scratch.row(y), 0, width);
+                }
+
+                channel.packedDilation.dilate(scratch, scratch);
+                if (channel.erode)
+                {
+                    channel.packedErosion.erode(scratch, scratch);
+                }
+                channel.packedSmoothing.dilate(scratch, scratch);
+
+                for (uint32_t y = 0; y < height; y++)
+                {
+                    PackedMask::copyBits(scratch.row(y), 0, channel.packedReduced.row(y0 + y), x0, width);
+                }
+
+}
+
+
+// Reduces the given area of the mask; pixels outside of it are treated as outside of the image.
+inline void reduceImage(ConeChannel &channel, const cv::Rect &area){
+
+                if (channel.packed)
+                {
+                    reducePackedImage(channel, area);
+                    return;
+                }
+
+                // Headers over the area alone, so that the filters do not look past its edges
+                const cv::Mat masked(area.height, area.width, CV_8UC1, channel.masked.ptr<uint8_t>(area.y, area.x), channel.masked.step);
+                cv::Mat reduced(area.height, area.width, CV_8UC1, channel.reduced.ptr<uint8_t>(area.y, area.x), channel.reduced.step);
+                cv::Mat scratch(area.height, area.width, CV_8UC1, channel.scratch.ptr<uint8_t>(area.y, area.x), channel.scratch.step);
+
+                if (channel.erode)
+                {
+                    channel.dilation.dilate(masked, reduced);
+                    channel.erosion.erode(reduced, scratch);
+                }
+                else
+                {
+                    channel.dilation.dilate(masked, scratch);
+                }
+
+                channel.smoothing.apply(scratch, reduced);
+
+}
+
+
+// Reduces the searched areas of the mask of one colour and the whole near band.
+inline void reduceImage(ConeChannel &channel, FrameWorkspace &ws){
+
+                forEachSearchArea(ws, [&channel](const cv::Rect &area) { reduceImage(channel, area); });
+                if (ws.near)
+                {
+                    ConeChannel &nearChannel = (&channel == &ws.yellow) ? ws.near->yellow : ws.near->blue;
+                    reduceImage(nearChannel, cv::Rect(0, 0, nearChannel.masked.cols, nearChannel.masked.rows));
+                }
+
+}
+
+
+// Averages every scale x scale block of the near band of the crop into one pixel of the band's image.
+inline void shrinkNearBand(const cv::Mat &frame, const cv::Rect &crop, NearBand &near){
+
+                const uint32_t scale = near.scale;
+                const uint32_t half = scale * scale / 2;
+                const uint32_t shift = (2 == scale) ? 2 : 4;
+                for (int32_t y = 0; y < near.bgra.rows; y++)
+                {
+                    uint8_t *out = near.bgra.ptr<uint8_t>(y);
+                    for (int32_t x = 0; x < near.bgra.cols; x++)
+                    {
+                        uint32_t sums[4] = {half, half, half, half};
+                        for (uint32_t dy = 0; dy < scale; dy++)
+                        {
+                            const uint8_t *in = frame.ptr<uint8_t>(crop.y + near.top + y * static_cast<int32_t>(scale) + static_cast<int32_t>(dy)) +
+                                                4 * static_cast<std::size_t>(x) * scale;
+                            for (uint32_t dx = 0; dx < 4 * scale; dx++)
+                            {
+                                sums[dx & 3] += in[dx];
+                            }
+                        }
+                        for (uint32_t c = 0; c < 4; c++)
+                        {
+                            out[4 * x + static_cast<int32_t>(c)] = static_cast<uint8_t>(sums[c] >> shift);
+                        }
+                    }
+                }
+
+}
+
+
+// Copies the rows of the region of interest, or the whole frame when it is displayed, out of the
+// shared memory into the workspace; rows outside of the region are left as they are.
+// The caller must hold the lock of the shared memory.
+inline void ingestFrame(const char *sharedData, FrameWorkspace &ws, bool wholeFrame){
+
+                const std::size_t step = ws.frame.step;
+                const int32_t firstRow = wholeFrame ? 0 : ws.crop.y;
+                const int32_t rows = wholeFrame ? ws.frame.rows : ws.crop.height;
+
+                std::memcpy(ws.frame.ptr<uint8_t>(firstRow), sharedData + static_cast<std::size_t>(firstRow) * step, static_cast<std::size_t>(rows) * step);
+
+}
+
+
+inline void maskCones(const ConeClassifier &classifier, const cv::Mat &cropped, cv::Mat &masked_y, cv::Mat &masked_blueWithoutReflection){
+
+                CV_Assert(cropped.type() == CV_8UC4);
+
+                // Yellow cones and blue cones without the large reflections, computed in a single pass over the crop
+                classifier.classify(cropped.ptr<uint8_t>(), cropped.step, static_cast<uint32_t>(cropped.cols), static_cast<uint32_t>(cropped.rows),
+                                    masked_y.ptr<uint8_t>(), masked_y.step, masked_blueWithoutReflection.ptr<uint8_t>(), masked_blueWithoutReflection.step);
+
+}
+
+
+// The same into the packed masks at the given area; every row is classified into maskRows and packed
+// while it is still in the cache.
+inline void maskPackedCones(const ConeClassifier &classifier, const cv::Mat &cropped, cv::Mat &maskRows, ConeChannel &yellow, ConeChannel &blue,
+                            const cv::Rect &area){
+
+                CV_Assert(cropped.type() == CV_8UC4);
+
+                const uint32_t width = static_cast<uint32_t>(area.width);
+                uint8_t *row_y = maskRows.ptr<uint8_t>(0);
+                uint8_t *row_b = maskRows.ptr<uint8_t>(1);
+                for (int32_t y = 0; y < area.height; y++)
+                {
+                    classifier.classify(cropped.ptr<uint8_t>(y), cropped.step, width, 1, row_y, maskRows.step, row_b, maskRows.step);
+                    yellow.packedMasked.pack(static_cast<uint32_t>(area.y + y), static_cast<uint32_t>(area.x), row_y, width);
+                    blue.packedMasked.pack(static_cast<uint32_t>(area.y + y), static_cast<uint32_t>(area.x), row_b, width);
+                }
+
+}
+
+
+// Share of frames whose calculated steering angle is close enough to the actual one,
+// counted separately for driving straight and for turning.
+struct SteeringAccuracy
+{
+            double turning_correct = 0.0;
+            double turning_incorrect = 0.0;
+            double turning_total = 0.0;
+            double straight_total = 0.0;
+            double straight_correct = 0.0;
+            double straight_incorrect = 0.0;
+            double straight_correct_p = 0.0;
+            double turning_correct_p = 0.0;
+            double straight_p = 0.0;
+            double turning_p = 0.0;
+            double total_p = 0.0;
+
+            void add(double actual_steeringAngle, double calculated_steeringAngle){
+
+                if (actual_steeringAngle >= 0 && actual_steeringAngle <= 0)
+                {
+                    straight_total += 1.0;
+                    if ((calculated_steeringAngle > (actual_steeringAngle * 1.05)) || (calculated_steeringAngle < (actual_steeringAngle * 0.95)))
+                    {
+                        straight_incorrect += 1.0;
+                    }
+                    else
+                    {
+                        straight_correct += 1.0;
+                    }
+                }
+                else
+                {
+                    turning_total += 1.0;
+                    if ((calculated_steeringAngle > (actual_steeringAngle * 1.5)) || (calculated_steeringAngle < (actual_steeringAngle * 0.5)))
+                    {
+                        turning_incorrect += 1.0;
+                    }
+                    else
+                    {
+                        turning_correct += 1.0;
+                    }
+                }
+
+                straight_correct_p = (straight_correct / (straight_correct + straight_incorrect)) * 100;
+                turning_correct_p = (turning_correct / (turning_correct + turning_incorrect)) * 100;
+                straight_p = (straight_total / (turning_total + straight_total)) * 100;
+                turning_p = (turning_total / (turning_total + straight_total)) * 100;
+                total_p = ((straight_correct_p * straight_p) + (turning_correct_p * turning_p)) / 100;
+                
+                //std::cout << "Correct 0 is " << straight_correct_p << std::endl;
+                //std::cout << "Correct turn is " << turning_correct_p << std::endl;
+                //std::cout << "straight total is " << straight_p << std::endl;
+                //std::cout << "turning total is " << turning_p << std::endl;
+                //std::cout << "Correct total is " << total_p << std::endl;
+                //std::cout << "nr of frames " << turning_total + straight_total << std::endl;
+            }
+};
+
+using ConeStage = FramePipeline<FrameWorkspace>::Stage;
+
+// Wraps a stage so that the duration of every call is recorded in a latency histogram of the same name.
+inline ConeStage timedStage(StageLatencies &latencies, const std::string &stageName, std::function<void(FrameWorkspace &)> &&process){
+
+                LatencyHistogram &latency = latencies.add(stageName);
+                return ConeStage{stageName, [&latency, process](FrameWorkspace &slot) {
+                    const LatencyHistogram::Clock::time_point start{LatencyHistogram::Clock::now()};
+                    process(slot);
+                    latency.recordSince(start);
+                }};
+
+}
+
+
+// Appends the stages from the colour mask to the steering angle; the caller adds the stage that uses
+// the result. With a channel pool the yellow and the blue chain run side by side in a single stage.
+// With a tracker only the windows around the tracked cones are searched between full scans.
+// Returns the index of the first stage that takes only microseconds, from the homography on.
+inline std::size_t addConeStages(std::vector<ConeStage> &stages, StageLatencies &latencies, const ConeClassifier &classifier, WorkerPool *channelPool,
+                          ConeTracker *tracker){
+
+                std::size_t lightStages{0};
+
+                stages.push_back(timedStage(latencies, "mask", [&classifier, tracker](FrameWorkspace &slot) {
+                    if (nullptr != tracker)
+                    {
+                        tracker->plan(slot);
+                    }
+                    forEachSearchArea(slot, [&classifier, &slot](const cv::Rect &area) {
+                        cv::Mat cropped = slot.frame(area + slot.crop.tl());
+                        if (slot.yellow.packed)
+                        {
+                            maskPackedCones(classifier, cropped, slot.maskRows, slot.yellow, slot.blue, area);
+                            return;
+                        }
+                        cv::Mat masked_y = slot.yellow.masked(area);
+                        cv::Mat masked_b = slot.blue.masked(area);
+                        maskCones(classifier, cropped, masked_y, masked_b);
+                    });
+                    if (slot.near)
+                    {
+                        shrinkNearBand(slot.frame, slot.crop, *slot.near);
+                        if (slot.near->yellow.packed)
+                        {
+                            maskPackedCones(classifier, slot.near->bgra, slot.maskRows, slot.near->yellow, slot.near->blue,
+                                            cv::Rect(0, 0, slot.near->bgra.cols, slot.near->bgra.rows));
+                        }
+                        else
+                        {
+                            maskCones(classifier, slot.near->bgra, slot.near->yellow.masked, slot.near->blue.masked);
+                        }
+                    }
+                }));
+                if (nullptr != channelPool)
+                {
+                    stages.push_back(timedStage(latencies, "channels", [channelPool](FrameWorkspace &slot) {
+                        channelPool->run(2, [&slot](uint32_t i) {
+                            ConeChannel &channel = (0 == i) ? slot.yellow : slot.blue;
+                            reduceImage(channel, slot);
+                            drawContours(channel, slot);
+                            transformCones(channel, slot.perspective);
+                        });
+                    }));
+                    lightStages = stages.size();
+                }
+                else
+                {
+                    stages.push_back(timedStage(latencies, "morphology", [](FrameWorkspace &slot) {
+                        reduceImage(slot.yellow, slot);
+                        reduceImage(slot.blue, slot);
+                    }));
+                    stages.push_back(timedStage(latencies, "blobs", [](FrameWorkspace &slot) {
+                        drawContours(slot.yellow, slot);
+                        drawContours(slot.blue, slot);
+                    }));
+                    lightStages = stages.size();
+                    stages.push_back(timedStage(latencies, "homography", [](FrameWorkspace &slot) {
+                        transformCones(slot.yellow, slot.perspective);
+                        transformCones(slot.blue, slot.perspective);
+                    }));
+                }
+                if (nullptr != tracker)
+                {
+                    stages.push_back(timedStage(latencies, "track", [tracker](FrameWorkspace &slot) {
+                        tracker->update(slot);
+                    }));
+                }
+                stages.push_back(timedStage(latencies, "steering", [](FrameWorkspace &slot) {
+                    slot.calculated_steeringAngle = calculateSteeringAngle(slot.yellow.cones, slot.blue.cones);
+                }));
+                return lightStages;
+
+}
+
+#endif
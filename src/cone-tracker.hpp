@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONE_TRACKER_HPP
+#define CONE_TRACKER_HPP
+
+#include "frame-workspace.hpp"
+#include "homography.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Follows the cones of both colours from frame to frame in bird's-eye
+// coordinates with a constant-velocity model. Every rescanPeriod frames, and
+// whenever a colour has fewer than the two cones the steering needs, the whole
+// crop is searched; in between only windows around the positions predicted
+// for the frame's sample time stamp are, so the cost follows the number of
+// cones instead of the size of the crop. A track that is not seen again is
+// predicted for a few more frames before it is dropped, which also bridges
+// single frames where a cone is missed.
+//
+// plan() is called by the stage that masks a frame and update() by the stage
+// after the homography; in the pipelined mode these are different threads, so
+// the tracks are guarded by a mutex that both hold only briefly.
+class ConeTracker
+{
+  public:
+    // rescanPeriod is the number of frames from one full search to the next.
+    ConeTracker(const Homography &perspective, const cv::Rect &crop, uint32_t rescanPeriod)
+        : m_crop(crop)
+        , m_rescanPeriod(std::max<uint32_t>(1, rescanPeriod))
+        , m_tracks()
+        , m_mutex()
+    {
+        const Homography inverse{perspective.inverse()};
+        std::copy(inverse.data(), inverse.data() + 9, m_inverse);
+        for (std::vector<Track> &tracks : m_tracks)
+        {
+            tracks.reserve(MAX_TRACKS);
+        }
+    }
+
+    ConeTracker(const ConeTracker &) = delete;
+    ConeTracker &operator=(const ConeTracker &) = delete;
+
+    // Decides whether the frame is searched completely or only in windows, in crop coordinates.
+    void plan(FrameWorkspace &ws)
+    {
+        ws.searchWindows.clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ws.fullScan = (0 == m_sinceFullScan % m_rescanPeriod) || (m_tracks[0].size() < 2) || (m_tracks[1].size() < 2);
+        if (!ws.fullScan)
+        {
+            for (const std::vector<Track> &tracks : m_tracks)
+            {
+                for (const Track &track : tracks)
+                {
+                    addWindow(ws.searchWindows, track, ws.sampleTimeStamp);
+                }
+            }
+            mergeWindows(ws.searchWindows);
+        }
+        m_sinceFullScan = ws.fullScan ? 1 : m_sinceFullScan + 1;
+
+        uint64_t searched{0};
+        for (const cv::Rect &window : ws.searchWindows)
+        {
+            searched += static_cast<uint64_t>(window.area());
+        }
+        m_frames.fetch_add(1, std::memory_order_relaxed);
+        m_fullScans.fetch_add(ws.fullScan ? 1 : 0, std::memory_order_relaxed);
+        m_searchedPixels.fetch_add(ws.fullScan ? static_cast<uint64_t>(m_crop.area()) : searched, std::memory_order_relaxed);
+    }
+
+    // Associates the cones found in the frame with the tracks and replaces them by the tracked cones.
+    void update(FrameWorkspace &ws)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        update(m_tracks[0], ws.yellow.cones, ws.sampleTimeStamp);
+        update(m_tracks[1], ws.blue.cones, ws.sampleTimeStamp);
+    }
+
+    void report(std::ostream &out) const
+    {
+        const uint64_t frames{m_frames.load()};
+        out << "tracker: " << m_fullScans.load() << " of " << frames << " frames searched completely";
+        if (0 < frames)
+        {
+            out << ", " << 100.0 * static_cast<double>(m_searchedPixels.load()) / (static_cast<double>(frames) * m_crop.area()) << "% of the crop searched on average";
+        }
+        out << std::endl;
+    }
+
+  private:
+    struct Track
+    {
+        cv::Point2f position{};
+        // Bird's-eye pixels per second
+        cv::Point2f velocity{};
+        int64_t sampleTimeStamp{0};
+        uint32_t missed{0};
+    };
+
+    static constexpr std::size_t MAX_TRACKS{64};
+    // Frames a track is predicted without being seen before it is dropped
+    static constexpr uint32_t MAX_MISSED{3};
+    // Largest distance in bird's-eye pixels between a predicted cone and a detection of it
+    static constexpr float GATE{40.0f};
+    // Half the size of a search window in frame pixels for a track seen in the last frame; the blur of
+    // the masks needs some room around a cone, and the window grows with every frame the cone was missed
+    static constexpr int32_t WINDOW_HALF_WIDTH{40};
+    static constexpr int32_t WINDOW_HALF_HEIGHT{24};
+
+    static cv::Point2f predict(const Track &track, int64_t sampleTimeStamp)
+    {
+        const float seconds{static_cast<float>(sampleTimeStamp - track.sampleTimeStamp) * 1e-6f};
+        return track.position + track.velocity * seconds;
+    }
+
+    void update(std::vector<Track> &tracks, std::vector<cv::Point2f> &cones, int64_t sampleTimeStamp)
+    {
+        // Greedy nearest-neighbour association of every cone with the closest free prediction
+        for (Track &track : tracks)
+        {
+            track.missed++;
+        }
+        for (const cv::Point2f &cone : cones)
+        {
+            Track *closest{nullptr};
+            float closestDistance{GATE * GATE};
+            for (Track &track : tracks)
+            {
+                const cv::Point2f offset{predict(track, sampleTimeStamp) - cone};
+                const float distance{offset.dot(offset)};
+                if ((0 < track.missed) && (distance < closestDistance))
+                {
+                    closest = &track;
+                    closestDistance = distance;
+                }
+            }
+            if (nullptr != closest)
+            {
+                const float seconds{static_cast<float>(sampleTimeStamp - closest->sampleTimeStamp) * 1e-6f};
+                if (0.0f < seconds)
+                {
+                    closest->velocity = 0.5f * closest->velocity + 0.5f * (cone - closest->position) * (1.0f / seconds);
+                }
+                closest->position = cone;
+                closest->sampleTimeStamp = sampleTimeStamp;
+                closest->missed = 0;
+            }
+            else if (tracks.size() < MAX_TRACKS)
+            {
+                tracks.push_back(Track{cone, cv::Point2f(0.0f, 0.0f), sampleTimeStamp, 0});
+            }
+        }
+
+        // Tracks that were not seen are predicted; those missed too often or gone out of view are dropped
+        cones.clear();
+        std::size_t kept{0};
+        for (const Track &track : tracks)
+        {
+            const cv::Point2f position{predict(track, sampleTimeStamp)};
+            if ((MAX_MISSED >= track.missed) && m_crop.contains(toFrame(position)))
+            {
+                tracks[kept++] = track;
+                cones.push_back(position);
+            }
+        }
+        tracks.resize(kept);
+    }
+
+    // Bird's-eye coordinates back to frame coordinates.
+    cv::Point toFrame(const cv::Point2f &p) const
+    {
+        const double w{m_inverse[6] * p.x + m_inverse[7] * p.y + m_inverse[8]};
+        if (std::fabs(w) < 1e-9)
+        {
+            return cv::Point(-1, -1);
+        }
+        const double x{(m_inverse[0] * p.x + m_inverse[1] * p.y + m_inverse[2]) / w};
+        const double y{(m_inverse[3] * p.x + m_inverse[4] * p.y + m_inverse[5]) / w};
+        return cv::Point(static_cast<int32_t>(std::lround(std::max(-1e6, std::min(1e6, x)))), static_cast<int32_t>(std::lround(std::max(-1e6, std::min(1e6, y)))));
+    }
+
+    void addWindow(std::vector<cv::Rect> &windows, const Track &track, int64_t sampleTimeStamp) const
+    {
+        const cv::Point center{toFrame(predict(track, sampleTimeStamp))};
+        const int32_t growth{static_cast<int32_t>(track.missed) + 1};
+        const cv::Rect window{center.x - WINDOW_HALF_WIDTH * growth, center.y - WINDOW_HALF_HEIGHT * growth, 2 * WINDOW_HALF_WIDTH * growth,
+                              2 * WINDOW_HALF_HEIGHT * growth};
+        const cv::Rect inCrop{window & m_crop};
+        if (0 < inCrop.area())
+        {
+            windows.push_back(inCrop - m_crop.tl());
+        }
+    }
+
+    // Overlapping windows are joined, so no pixel is searched twice and no cone is split between two windows.
+    static void mergeWindows(std::vector<cv::Rect> &windows)
+    {
+        bool merged{true};
+        while (merged)
+        {
+            merged = false;
+            for (std::size_t i = 0; i < windows.size(); i++)
+            {
+                for (std::size_t j = i + 1; j < windows.size(); j++)
+                {
+                    if (0 < (windows[i] & windows[j]).area())
+                    {
+                        windows[i] |= windows[j];
+                        windows[j] = windows.back();
+                        windows.pop_back();
+                        merged = true;
+                        j = i;
+                    }
+                }
+            }
+        }
+    }
+
+  private:
+    const cv::Rect m_crop;
+    const uint32_t m_rescanPeriod;
+    double m_inverse[9]{};
+    // Yellow and blue
+    std::vector<Track> m_tracks[2];
+    uint32_t m_sinceFullScan{0};
+    std::mutex m_mutex;
+
+    std::atomic<uint64_t> m_frames{0};
+    std::atomic<uint64_t> m_fullScans{0};
+    std::atomic<uint64_t> m_searchedPixels{0};
+};
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_PIPELINE_HPP
+#define FRAME_PIPELINE_HPP
+
+#include "spsc-ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pins the given thread to one CPU, which has to exist; a no-op where affinity is not supported.
+inline void pinThread(std::thread::native_handle_type thread, uint32_t cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+}
+
+inline void pinCurrentThread(uint32_t cpu)
+{
+#ifdef __linux__
+    pinThread(pthread_self(), cpu);
+#else
+    (void)cpu;
+#endif
+}
+
+// Runs the stages of a frame pipeline on one thread each. Frames travel in a
+// fixed set of preallocated slots: the producer takes a free slot, fills it
+// and submits it; every stage pops the slot from its bounded lock-free
+// single-producer/single-consumer ring, processes it and pushes it to the
+// next stage, and the last stage hands the slot back to the producer. While
+// the pipeline is full, acquire() returns nullptr and the producer has to
+// drop the frame instead of queueing up latency. With pinning, the producer
+// runs on CPU 0 and the stages on one CPU each from CPU 1 on; stages beyond
+// the last CPU are not pinned, so no two stages share a core with each other
+// or with the producer.
+template <typename Slot>
+class FramePipeline
+{
+  public:
+    struct Stage
+    {
+        std::string name;
+        std::function<void(Slot &)> process;
+    };
+
+    FramePipeline(std::vector<std::unique_ptr<Slot>> &&slots, std::vector<Stage> &&stages, bool pinThreads)
+        : m_slots(std::move(slots))
+        , m_stages(std::move(stages))
+        , m_free(m_slots.size())
+        , m_start(std::chrono::steady_clock::now())
+    {
+        for (std::unique_ptr<Slot> &slot : m_slots)
+        {
+            m_free.push(slot.get());
+        }
+        for (std::size_t i = 0; i < m_stages.size(); i++)
+        {
+            m_queues.emplace_back(new SpscRing<Slot *>(m_slots.size()));
+            m_metrics.emplace_back(new Metrics);
+        }
+        if (pinThreads)
+        {
+            pinCurrentThread(0);
+        }
+        const std::size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t i = 0; i < m_stages.size(); i++)
+        {
+            m_threads.emplace_back(&FramePipeline::run, this, i);
+            if (pinThreads && (i + 1 < cpus))
+            {
+                pinThread(m_threads.back().native_handle(), static_cast<uint32_t>(i + 1));
+            }
+        }
+    }
+
+    // Runs the stages from index first on in turn on a single thread under the given name; for stages
+    // that take only microseconds and would otherwise each keep a core busy polling.
+    static void mergeStages(std::vector<Stage> &stages, std::size_t first, const std::string &name)
+    {
+        if (first + 1 >= stages.size())
+        {
+            return;
+        }
+        std::vector<Stage> merged(std::make_move_iterator(stages.begin() + static_cast<std::ptrdiff_t>(first)), std::make_move_iterator(stages.end()));
+        stages.erase(stages.begin() + static_cast<std::ptrdiff_t>(first), stages.end());
+        stages.push_back(Stage{name, [merged](Slot &slot) {
+                                   for (const Stage &stage : merged)
+                                   {
+                                       stage.process(slot);
+                                   }
+                               }});
+    }
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    ~FramePipeline()
+    {
+        stop();
+    }
+
+    // Producer side: a free slot or nullptr when all slots are in flight.
+    Slot *acquire()
+    {
+        Slot *slot{nullptr};
+        if (!m_free.pop(slot))
+        {
+            m_dropped++;
+            return nullptr;
+        }
+        return slot;
+    }
+
+    // Producer side: hands a filled slot to the first stage.
+    void submit(Slot *slot)
+    {
+        // Cannot fail as every ring holds all slots.
+        m_queues.front()->push(slot);
+    }
+
+    // Lets the stages finish the frames in flight and joins them.
+    void stop()
+    {
+        m_stopping.store(true);
+        for (std::thread &thread : m_threads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    uint64_t dropped() const { return m_dropped.load(); }
+
+    // Frames, share of wall time spent busy and input queue occupancy per stage.
+    void report(std::ostream &out) const
+    {
+        const double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+        out << "pipeline: " << m_dropped.load() << " frames dropped while all " << m_slots.size() << " slots were in flight" << std::endl;
+        for (std::size_t i = 0; i < m_stages.size(); i++)
+        {
+            const Metrics &metrics = *m_metrics[i];
+            const uint64_t processed = metrics.processed.load(std::memory_order_relaxed);
+            const double busy = 100.0 * static_cast<double>(metrics.busyNanoseconds.load(std::memory_order_relaxed)) / std::max(1.0, elapsed);
+            const double occupancy = (0 < processed) ? static_cast<double>(metrics.occupancySum.load(std::memory_order_relaxed)) / static_cast<double>(processed) : 0.0;
+            out << "  " << std::left << std::setw(12) << m_stages[i].name << std::right << processed << " frames, " << std::fixed << std::setprecision(1) << busy
+                << "% busy, queue avg " << std::setprecision(2) << occupancy << " max " << metrics.occupancyMax.load(std::memory_order_relaxed) << "/"
+                << m_queues[i]->capacity() << std::defaultfloat << std::endl;
+        }
+    }
+
+  private:
+    struct Metrics
+    {
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> busyNanoseconds{0};
+        std::atomic<uint64_t> occupancySum{0};
+        std::atomic<uint64_t> occupancyMax{0};
+        std::atomic<bool> finished{false};
+        // Keeps the counters of neighbouring stages off each other's cache line.
+        char padding[64]{};
+    };
+
+    void run(std::size_t index)
+    {
+        SpscRing<Slot *> &input = *m_queues[index];
+        Metrics &metrics = *m_metrics[index];
+        const Stage &stage = m_stages[index];
+        const bool isLast = (index + 1 == m_stages.size());
+        uint32_t idle{0};
+
+        while (true)
+        {
+            // Read before popping: once upstream has finished, all its slots
+            // are visible here and an empty ring means there is nothing left.
+            const bool drained = m_stopping.load() && ((0 == index) || m_metrics[index - 1]->finished.load());
+            // Occupancy as seen by this stage, including the slot it takes.
+            const uint64_t occupancy = input.size();
+            Slot *slot{nullptr};
+            if (!input.pop(slot))
+            {
+                if (drained)
+                {
+                    break;
+                }
+                backoff(idle++);
+                continue;
+            }
+            idle = 0;
+
+            const auto before = std::chrono::steady_clock::now();
+            stage.process(*slot);
+            const auto after = std::chrono::steady_clock::now();
+
+            metrics.processed.fetch_add(1, std::memory_order_relaxed);
+            metrics.busyNanoseconds.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()), std::memory_order_relaxed);
+            metrics.occupancySum.fetch_add(occupancy, std::memory_order_relaxed);
+            if (occupancy > metrics.occupancyMax.load(std::memory_order_relaxed))
+            {
+                metrics.occupancyMax.store(occupancy, std::memory_order_relaxed);
+            }
+
+            if (isLast)
+            {
+                m_free.push(slot);
+            }
+            else
+            {
+                m_queues[index + 1]->push(slot);
+            }
+        }
+        metrics.finished.store(true);
+    }
+
+    // Spins first, then yields and finally sleeps so idle stages do not burn a core.
+    static void backoff(uint32_t idle)
+    {
+        if (idle < 64)
+        {
+            return;
+        }
+        if (idle < 1024)
+        {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+  private:
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    std::vector<Stage> m_stages;
+    SpscRing<Slot *> m_free;
+    std::vector<std::unique_ptr<SpscRing<Slot *>>> m_queues{};
+    std::vector<std::unique_ptr<Metrics>> m_metrics{};
+    std::vector<std::thread> m_threads{};
+    std::atomic<bool> m_stopping{false};
+    std::atomic<uint64_t> m_dropped{0};
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_SCHEDULER_HPP
+#define FRAME_SCHEDULER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Bookkeeping for processing always the newest frame of the shared memory.
+// The shared memory holds a single frame, so a frame that was overwritten
+// before it was read is lost; such frames are counted from the gaps between
+// the sample time stamps, measured in frame periods. The period is the
+// nominal one of the camera when it is given; otherwise it is the shortest
+// of the recent gaps that were about one period long. Longer gaps are
+// multiples of the period and do not change it, so it holds even when most
+// frames are dropped; a source that only ever delivers every n-th frame
+// needs the nominal period. A frame that is not done within the deadline
+// after it was taken out of the shared memory is a deadline miss; with a
+// deadline of 0 frames never miss. accept() and skip() are called by the
+// thread that reads the shared memory; the miss counters may be updated from
+// another one.
+class FrameScheduler
+{
+  public:
+    // A period of 0 is estimated from the gaps between the frames.
+    explicit FrameScheduler(int64_t deadlineMicroseconds, int64_t periodMicroseconds = 0)
+        : m_deadline(deadlineMicroseconds)
+        , m_nominalPeriod(0 < periodMicroseconds)
+        , m_period(std::max<int64_t>(0, periodMicroseconds))
+    {
+    }
+
+    FrameScheduler(const FrameScheduler &) = delete;
+    FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+    // False for the frame that was taken out last, processed or skipped, so the caller has to wait for the next one.
+    bool isNewFrame(int64_t sampleTimeStamp) const
+    {
+        return !m_seen || (sampleTimeStamp != m_lastTimeStamp);
+    }
+
+    // The frame with the given time stamp is going to be processed.
+    void accept(int64_t sampleTimeStamp)
+    {
+        see(sampleTimeStamp);
+        m_processed.fetch_add(1);
+    }
+
+    // The frame with the given time stamp was taken out but is not processed, as the pipeline was full;
+    // the pipeline counts it.
+    void skip(int64_t sampleTimeStamp)
+    {
+        see(sampleTimeStamp);
+    }
+
+    // True while a frame taken at startedMicroseconds is still within its deadline.
+    bool withinDeadline(int64_t startedMicroseconds, int64_t nowMicroseconds) const
+    {
+        return (0 == m_deadline) || (nowMicroseconds - startedMicroseconds <= m_deadline);
+    }
+
+    // A frame missed its deadline and its result is not output.
+    void miss()
+    {
+        m_missed.fetch_add(1);
+    }
+
+    int64_t deadline() const { return m_deadline; }
+
+    void report(std::ostream &out) const
+    {
+        out << "scheduler: " << m_processed.load() << " frames processed, " << m_dropped.load() << " dropped";
+        if (0 < m_period)
+        {
+            out << " (frame period " << m_period << " us)";
+        }
+        if (0 < m_deadline)
+        {
+            out << ", " << m_missed.load() << " abandoned after missing the deadline of " << m_deadline << " us";
+        }
+        out << std::endl;
+    }
+
+  private:
+    // Frames missing between the frame taken out last and this one were overwritten before they were read.
+    void see(int64_t sampleTimeStamp)
+    {
+        if (m_seen)
+        {
+            const int64_t gap = sampleTimeStamp - m_lastTimeStamp;
+            if (0 < gap)
+            {
+                if (0 < m_period)
+                {
+                    const int64_t periods = std::llround(static_cast<double>(gap) / static_cast<double>(m_period));
+                    if (1 < periods)
+                    {
+                        m_dropped.fetch_add(static_cast<uint64_t>(periods - 1));
+                    }
+                }
+                // Only gaps of about one period are taken, so gaps of dropped frames cannot raise it
+                if (!m_nominalPeriod && ((0 == m_period) || (2 * gap < 3 * m_period)))
+                {
+                    m_gaps[m_gapCount++ % m_gaps.size()] = gap;
+                    m_period = shortestGap();
+                }
+            }
+        }
+        m_lastTimeStamp = sampleTimeStamp;
+        m_seen = true;
+    }
+
+    int64_t shortestGap() const
+    {
+        const std::size_t count = (m_gapCount < m_gaps.size()) ? static_cast<std::size_t>(m_gapCount) : m_gaps.size();
+        return *std::min_element(m_gaps.begin(), m_gaps.begin() + count);
+    }
+
+  private:
+    static constexpr std::size_t GAPS{256};
+
+    const int64_t m_deadline;
+    const bool m_nominalPeriod;
+    bool m_seen{false};
+    int64_t m_lastTimeStamp{0};
+    int64_t m_period;
+    std::array<int64_t, GAPS> m_gaps{};
+    uint64_t m_gapCount{0};
+    std::atomic<uint64_t> m_processed{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_missed{0};
+};
+
+#endif
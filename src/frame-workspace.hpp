@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_WORKSPACE_HPP
+#define FRAME_WORKSPACE_HPP
+
+#include "cone-blob-extractor.hpp"
+#include "homography.hpp"
+#include "mask-morphology.hpp"
+#include "packed-mask.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Elliptical structuring element from OpenCV turned into row spans.
+inline std::vector<std::pair<int32_t, int32_t>> ellipseSpans(int32_t size)
+{
+    const cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size));
+    std::vector<std::pair<int32_t, int32_t>> rowSpans;
+    for (int32_t y = 0; y < element.rows; y++)
+    {
+        int32_t first = 0;
+        int32_t second = 0;
+        for (int32_t x = 0; x < element.cols; x++)
+        {
+            if (0 != element.at<uint8_t>(y, x))
+            {
+                first = (first == second) ? x : first;
+                second = x + 1;
+            }
+        }
+        rowSpans.emplace_back(first, second);
+    }
+    return rowSpans;
+}
+
+inline MaskMorphology ellipseMorphology(int32_t size)
+{
+    return MaskMorphology{cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size))};
+}
+
+// Buffers of one cone colour, from the colour mask to the bird's-eye centroids.
+struct ConeChannel
+{
+    ConeChannel(uint32_t width, uint32_t height, int32_t dilateSize, int32_t erodeSize, uint32_t minConeArea, uint32_t maxConeArea,
+                int32_t smoothSize = 15)
+        : masked(static_cast<int>(height), static_cast<int>(width), CV_8UC1)
+        , reduced(static_cast<int>(height), static_cast<int>(width), CV_8UC1)
+        , scratch(static_cast<int>(height), static_cast<int>(width), CV_8UC1)
+        , dilation(ellipseMorphology(dilateSize))
+        , erosion(ellipseMorphology(std::max(erodeSize, 1)))
+        , erode(0 < erodeSize)
+        , smoothing(smoothSize, 0)
+        , blobs(minConeArea, maxConeArea)
+        , packedDilation(ellipseSpans(dilateSize), dilateSize / 2, dilateSize / 2)
+        , packedErosion(ellipseSpans(std::max(erodeSize, 1)), std::max(erodeSize, 1) / 2, std::max(erodeSize, 1) / 2)
+        , packedSmoothing(smoothingSupport(smoothing))
+    {
+        blobs.reserve(width, height);
+        const std::size_t maxBlobs = static_cast<std::size_t>(height) * ((width + 1) / 2);
+        mc.reserve(maxBlobs);
+        cones.reserve(maxBlobs);
+    }
+
+    // Keeps the masks bit-packed from the classification to the blobs; the blur becomes a binary dilation
+    // with its support (see smoothingSupport()). The buffers are only sized when this is used.
+    void usePackedMasks()
+    {
+        const uint32_t width = static_cast<uint32_t>(masked.cols);
+        const uint32_t height = static_cast<uint32_t>(masked.rows);
+        packed = true;
+        packedMasked.resize(width, height);
+        packedReduced.resize(width, height);
+        packedScratch.resize(width, height);
+        packedDilation.reserve(width, height);
+        packedErosion.reserve(width, height);
+        packedSmoothing.reserve(width, height);
+    }
+
+    cv::Mat masked;
+    cv::Mat reduced;
+    // Between two of the filters, so that none of them runs in place.
+    cv::Mat scratch;
+    MaskMorphology dilation;
+    MaskMorphology erosion;
+    bool erode;
+    MaskSmoothing smoothing;
+    ConeBlobExtractor blobs;
+    // Mass centers in frame coordinates and in the bird's-eye view.
+    std::vector<cv::Point2f> mc{};
+    std::vector<cv::Point2f> cones{};
+    // Set with usePackedMasks().
+    bool packed{false};
+    PackedMask packedMasked{};
+    PackedMask packedReduced{};
+    // Searched areas are copied here to be processed on their own.
+    PackedMask packedScratch{};
+    PackedMorphology packedDilation;
+    PackedMorphology packedErosion;
+    PackedMorphology packedSmoothing;
+};
+
+// The bottom rows of the crop, where the cones are close and large, reduced
+// by an integer factor in both directions; each channel is set up with its
+// structuring elements, blur and cone areas scaled down to match.
+struct NearBand
+{
+    NearBand(uint32_t width, uint32_t cropHeight, uint32_t rows, uint32_t reduction, uint32_t minConeArea, uint32_t maxConeArea)
+        : scale(reduction)
+        , top(static_cast<int32_t>(cropHeight - rows))
+        , bgra(static_cast<int>(rows / reduction), static_cast<int>(width / reduction), CV_8UC4)
+        , yellow(width / reduction, rows / reduction, scaled(3, reduction), scaled(6, reduction), scaledArea(minConeArea, reduction),
+                 scaledArea(maxConeArea, reduction), scaled(15, reduction) | 1)
+        , blue(width / reduction, rows / reduction, scaled(7, reduction), 0, scaledArea(minConeArea, reduction), scaledArea(maxConeArea, reduction),
+               scaled(15, reduction) | 1)
+    {
+    }
+
+    static int32_t scaled(int32_t size, uint32_t reduction)
+    {
+        return std::max<int32_t>(1, size / static_cast<int32_t>(reduction));
+    }
+
+    static uint32_t scaledArea(uint32_t area, uint32_t reduction)
+    {
+        return std::max<uint32_t>(1, area / (reduction * reduction));
+    }
+
+    uint32_t scale;
+    // First row of the band in crop coordinates.
+    int32_t top;
+    cv::Mat bgra;
+    ConeChannel yellow;
+    ConeChannel blue;
+};
+
+// Everything the cone pipeline needs per frame, sized once from --width and
+// --height and reused for every frame so that the steady-state loop does not
+// touch the heap. The region of interest is clamped to the frame. In the
+// pipelined mode every slot in flight is one FrameWorkspace.
+struct FrameWorkspace
+{
+    FrameWorkspace(uint32_t width, uint32_t height, uint32_t roiTop, uint32_t roiHeight, const Homography &perspectiveTransform,
+                   uint32_t minConeArea, uint32_t maxConeArea)
+        : frame(static_cast<int>(height), static_cast<int>(width), CV_8UC4, cv::Scalar(0))
+        , crop(cropOf(width, height, roiTop, roiHeight))
+        , perspective(perspectiveTransform)
+        , yellow(width, static_cast<uint32_t>(crop.height), 3, 6, minConeArea, maxConeArea)
+        , blue(width, static_cast<uint32_t>(crop.height), 7, 0, minConeArea, maxConeArea)
+    {
+        searchWindows.reserve(256);
+    }
+
+    // Processes the bottom rows of the crop reduced by a factor of 2 or 4 and only the rows above them at
+    // full resolution; rows are rounded down to a multiple of the factor.
+    void useNearBand(uint32_t rows, uint32_t reduction)
+    {
+        const uint32_t cropHeight{static_cast<uint32_t>(crop.height)};
+        rows = std::min(rows, cropHeight) / reduction * reduction;
+        if (isValidReduction(reduction) && (0 < rows) && (reduction <= static_cast<uint32_t>(crop.width)))
+        {
+            near.reset(new NearBand{static_cast<uint32_t>(crop.width), cropHeight, rows, reduction, yellow.blobs.minArea(), yellow.blobs.maxArea()});
+            if (yellow.packed)
+            {
+                near->yellow.usePackedMasks();
+                near->blue.usePackedMasks();
+            }
+        }
+    }
+
+    // Keeps the masks of both colours, and of the near band, bit-packed; see ConeChannel::usePackedMasks().
+    void usePackedMasks()
+    {
+        yellow.usePackedMasks();
+        blue.usePackedMasks();
+        if (near)
+        {
+            near->yellow.usePackedMasks();
+            near->blue.usePackedMasks();
+        }
+        maskRows.create(2, crop.width, CV_8UC1);
+    }
+
+    static bool isValidReduction(uint32_t reduction)
+    {
+        return (2 == reduction) || (4 == reduction);
+    }
+
+    // Rows of the crop that are processed at full resolution.
+    int32_t farRows() const
+    {
+        return near ? near->top : crop.height;
+    }
+
+    // Region of interest clamped to the frame.
+    static cv::Rect cropOf(uint32_t width, uint32_t height, uint32_t roiTop, uint32_t roiHeight)
+    {
+        return cv::Rect(0, static_cast<int>(std::min(roiTop, height - 1)), static_cast<int>(width),
+                        static_cast<int>(std::max<uint32_t>(1, std::min(roiHeight, height - std::min(roiTop, height - 1)))));
+    }
+
+    cv::Mat frame;
+    cv::Rect crop;
+    Homography perspective;
+    ConeChannel yellow;
+    ConeChannel blue;
+    // Per-frame values that travel with the buffers through the pipeline stages.
+    int64_t startedMicroseconds{0};
+    int64_t sampleTimeStamp{0};
+    double actual_steeringAngle{0.0};
+    double calculated_steeringAngle{0.0};
+    // Parts of the crop that are searched for cones: all of it, or the windows around the tracked cones.
+    bool fullScan{true};
+    std::vector<cv::Rect> searchWindows{};
+    // Set with useNearBand().
+    std::unique_ptr<NearBand> near{};
+    // One row of the yellow and the blue mask on their way into the packed masks.
+    cv::Mat maskRows{};
+};
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOMOGRAPHY_HPP
+#define HOMOGRAPHY_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HOMOGRAPHY_X86 1
+#endif
+
+// A point of the camera image and where it lies in the bird's-eye view.
+struct VertexPair
+{
+    float srcX;
+    float srcY;
+    float dstX;
+    float dstY;
+};
+
+// Fixed 3x3 perspective transform, row-major. It is solved once from four
+// vertex pairs, at compile time for the built-in calibration, and then only
+// applied: transform() maps a whole array of points the way
+// cv::perspectiveTransform() maps a std::vector<cv::Point2f>, with the same
+// float rounding, so the results are identical.
+class Homography
+{
+  public:
+    constexpr Homography()
+        : m_h{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}
+    {
+    }
+
+    explicit Homography(const cv::Mat &m)
+        : m_h{}
+    {
+        for (int32_t i = 0; i < 9; i++)
+        {
+            m_h[i] = m.at<double>(i / 3, i % 3);
+        }
+    }
+
+    // Solves for the transform that maps the four src vertices onto the dst vertices by Gaussian
+    // elimination; an invalid transform if three vertices are collinear. OpenCV 3.2 solves the same
+    // system with DECOMP_SVD instead. For CLOSE_PERSPECTIVE the result was checked against numpy's
+    // solve (relative error ~1e-15, 1e-13 for the perspective terms) and against an SVD solve
+    // (~1e-9, the system is ill-conditioned); the vertices map to within 1e-12 px either way.
+    static constexpr Homography fromVertices(const VertexPair (&vertices)[4])
+    {
+        double a[8][8]{};
+        double b[8]{};
+        for (int32_t i = 0; i < 4; i++)
+        {
+            const VertexPair &v = vertices[i];
+            a[i][0] = a[i + 4][3] = v.srcX;
+            a[i][1] = a[i + 4][4] = v.srcY;
+            a[i][2] = a[i + 4][5] = 1.0;
+            a[i][6] = -v.srcX * v.dstX;
+            a[i][7] = -v.srcY * v.dstX;
+            a[i + 4][6] = -v.srcX * v.dstY;
+            a[i + 4][7] = -v.srcY * v.dstY;
+            b[i] = v.dstX;
+            b[i + 4] = v.dstY;
+        }
+
+        // Gaussian elimination with partial pivoting; the diagonal keeps the reciprocal pivots
+        Homography h{};
+        for (int32_t i = 0; i < 8; i++)
+        {
+            int32_t pivot = i;
+            for (int32_t j = i + 1; j < 8; j++)
+            {
+                if (absolute(a[j][i]) > absolute(a[pivot][i]))
+                {
+                    pivot = j;
+                }
+            }
+            if (absolute(a[pivot][i]) < DBL_EPSILON * 100)
+            {
+                h.m_h[8] = 0.0;
+                return h;
+            }
+            if (pivot != i)
+            {
+                for (int32_t j = i; j < 8; j++)
+                {
+                    const double t = a[i][j];
+                    a[i][j] = a[pivot][j];
+                    a[pivot][j] = t;
+                }
+                const double t = b[i];
+                b[i] = b[pivot];
+                b[pivot] = t;
+            }
+            const double d = -1.0 / a[i][i];
+            for (int32_t j = i + 1; j < 8; j++)
+            {
+                const double alpha = a[j][i] * d;
+                for (int32_t k = i + 1; k < 8; k++)
+                {
+                    a[j][k] += alpha * a[i][k];
+                }
+                b[j] += alpha * b[i];
+            }
+            a[i][i] = -d;
+        }
+        for (int32_t i = 7; i >= 0; i--)
+        {
+            double s = b[i];
+            for (int32_t k = i + 1; k < 8; k++)
+            {
+                s -= a[i][k] * b[k];
+            }
+            b[i] = s * a[i][i];
+        }
+
+        for (int32_t i = 0; i < 8; i++)
+        {
+            h.m_h[i] = b[i];
+        }
+        h.m_h[8] = 1.0;
+        return h;
+    }
+
+    // Reads a calibration: either the nine values of the matrix, row by row, or four lines of
+    // "srcX srcY dstX dstY"; text after a '#' is ignored. Returns false if the file has neither.
+    static bool load(const std::string &path, Homography &h)
+    {
+        std::ifstream in(path);
+        std::vector<double> values;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line.substr(0, line.find('#')));
+            double value{0.0};
+            while (fields >> value)
+            {
+                values.push_back(value);
+            }
+            if (!fields.eof())
+            {
+                return false;
+            }
+        }
+        if (9 == values.size())
+        {
+            for (std::size_t i = 0; i < 9; i++)
+            {
+                h.m_h[i] = values[i];
+            }
+        }
+        else if (16 == values.size())
+        {
+            VertexPair vertices[4]{};
+            for (std::size_t i = 0; i < 4; i++)
+            {
+                vertices[i] = VertexPair{static_cast<float>(values[4 * i]), static_cast<float>(values[4 * i + 1]), static_cast<float>(values[4 * i + 2]),
+                                         static_cast<float>(values[4 * i + 3])};
+            }
+            h = fromVertices(vertices);
+        }
+        else
+        {
+            return false;
+        }
+        return h.valid();
+    }
+
+    constexpr bool valid() const
+    {
+        return 0.0 < absolute(determinant());
+    }
+
+    constexpr double determinant() const
+    {
+        return m_h[0] * (m_h[4] * m_h[8] - m_h[5] * m_h[7]) - m_h[1] * (m_h[3] * m_h[8] - m_h[5] * m_h[6]) + m_h[2] * (m_h[3] * m_h[7] - m_h[4] * m_h[6]);
+    }
+
+    // The transform from the bird's-eye view back to the image.
+    Homography inverse() const
+    {
+        const double d = 1.0 / determinant();
+        Homography inv{};
+        inv.m_h[0] = (m_h[4] * m_h[8] - m_h[5] * m_h[7]) * d;
+        inv.m_h[1] = (m_h[2] * m_h[7] - m_h[1] * m_h[8]) * d;
+        inv.m_h[2] = (m_h[1] * m_h[5] - m_h[2] * m_h[4]) * d;
+        inv.m_h[3] = (m_h[5] * m_h[6] - m_h[3] * m_h[8]) * d;
+        inv.m_h[4] = (m_h[0] * m_h[8] - m_h[2] * m_h[6]) * d;
+        inv.m_h[5] = (m_h[2] * m_h[3] - m_h[0] * m_h[5]) * d;
+        inv.m_h[6] = (m_h[3] * m_h[7] - m_h[4] * m_h[6]) * d;
+        inv.m_h[7] = (m_h[1] * m_h[6] - m_h[0] * m_h[7]) * d;
+        inv.m_h[8] = (m_h[0] * m_h[4] - m_h[1] * m_h[3]) * d;
+        return inv;
+    }
+
+    // The matrix for OpenCV functions like cv::warpPerspective().
+    cv::Mat toMat() const
+    {
+        cv::Mat m(3, 3, CV_64F);
+        for (int32_t i = 0; i < 9; i++)
+        {
+            m.at<double>(i / 3, i % 3) = m_h[i];
+        }
+        return m;
+    }
+
+    const double *data() const { return m_h; }
+
+    // Maps count points from src to dst, which may be the same array; points on the horizon become (0, 0).
+    void transform(const cv::Point2f *src, cv::Point2f *dst, std::size_t count) const
+    {
+        std::size_t i = 0;
+#ifdef HOMOGRAPHY_X86
+        if (hasAvx2())
+        {
+            i = transformAvx2(src, dst, count);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            const float x = src[i].x;
+            const float y = src[i].y;
+            float w = static_cast<float>(x * m_h[6] + y * m_h[7] + m_h[8]);
+            if (std::fabs(w) > FLT_EPSILON)
+            {
+                w = static_cast<float>(1.0 / w);
+                dst[i] = cv::Point2f(static_cast<float>((x * m_h[0] + y * m_h[1] + m_h[2]) * w), static_cast<float>((x * m_h[3] + y * m_h[4] + m_h[5]) * w));
+            }
+            else
+            {
+                dst[i] = cv::Point2f(0.0f, 0.0f);
+            }
+        }
+    }
+
+  private:
+    static constexpr double absolute(double v)
+    {
+        return (v < 0.0) ? -v : v;
+    }
+
+#ifdef HOMOGRAPHY_X86
+    static bool hasAvx2()
+    {
+        static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return avx2;
+    }
+
+    // Four points at a time in double lanes, rounded to float at the same steps as the scalar code.
+    __attribute__((target("avx2"))) std::size_t transformAvx2(const cv::Point2f *src, cv::Point2f *dst, std::size_t count) const
+    {
+        const float *in = &src[0].x;
+        float *out = &dst[0].x;
+        __m256d h[9];
+        for (int32_t k = 0; k < 9; k++)
+        {
+            h[k] = _mm256_set1_pd(m_h[k]);
+        }
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d epsilon = _mm256_set1_pd(FLT_EPSILON);
+        const __m256d sign = _mm256_set1_pd(-0.0);
+
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            // x0 y0 x1 y1 and x2 y2 x3 y3 become x0 x2 x1 x3 and y0 y2 y1 y3
+            const __m256 points = _mm256_loadu_ps(in + 2 * i);
+            const __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(points));
+            const __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(points, 1));
+            const __m256d x = _mm256_unpacklo_pd(lo, hi);
+            const __m256d y = _mm256_unpackhi_pd(lo, hi);
+
+            __m256d w = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, h[6]), _mm256_mul_pd(y, h[7])), h[8]);
+            w = _mm256_cvtps_pd(_mm256_cvtpd_ps(w));
+            const __m256d visible = _mm256_cmp_pd(_mm256_andnot_pd(sign, w), epsilon, _CMP_GT_OQ);
+            w = _mm256_cvtps_pd(_mm256_cvtpd_ps(_mm256_div_pd(one, w)));
+            const __m256d u = _mm256_and_pd(visible, _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, h[0]), _mm256_mul_pd(y, h[1])), h[2]), w));
+            const __m256d v = _mm256_and_pd(visible, _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, h[3]), _mm256_mul_pd(y, h[4])), h[5]), w));
+
+            // And back to x0 y0 x1 y1 x2 y2 x3 y3
+            const __m128 first = _mm256_cvtpd_ps(_mm256_unpacklo_pd(u, v));
+            const __m128 second = _mm256_cvtpd_ps(_mm256_unpackhi_pd(u, v));
+            _mm256_storeu_ps(out + 2 * i, _mm256_insertf128_ps(_mm256_castps128_ps256(first), second, 1));
+        }
+        return i;
+    }
+#endif
+
+  private:
+    double m_h[9];
+};
+
+#endif
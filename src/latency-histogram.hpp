@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Histogram of latencies in nanoseconds in the manner of HdrHistogram: every
+// power of two is split into SUB_BUCKETS linear buckets, so each value is
+// kept with a relative error below 1/SUB_BUCKETS (about 3%) from 1 ns up to
+// about 36 minutes (2^41 ns) with a fixed table. Recording takes a few integer
+// operations and relaxed stores; one thread records while any other thread
+// may read the percentiles.
+class LatencyHistogram
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    LatencyHistogram()
+        : m_counts()
+    {
+        for (std::atomic<uint64_t> &count : m_counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    void record(uint64_t nanoseconds)
+    {
+        nanoseconds = std::min(nanoseconds, MAX_VALUE);
+        std::atomic<uint64_t> &count = m_counts[bucketOf(nanoseconds)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_total.store(m_total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (nanoseconds > m_max.load(std::memory_order_relaxed))
+        {
+            m_max.store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    void recordSince(Clock::time_point start)
+    {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+    }
+
+    uint64_t count() const { return m_total.load(std::memory_order_relaxed); }
+
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // Highest value of the bucket that holds the given percentile (0..100).
+    uint64_t percentile(double p) const
+    {
+        const uint64_t total = count();
+        if (0 == total)
+        {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (uint32_t bucket = 0; bucket < BUCKETS; bucket++)
+        {
+            seen += m_counts[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(highestValueOf(bucket), max());
+            }
+        }
+        return max();
+    }
+
+  private:
+    static constexpr uint32_t SUB_BITS = 5;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr uint32_t MAX_MAGNITUDE = 40;
+    static constexpr uint64_t MAX_VALUE = (uint64_t{1} << (MAX_MAGNITUDE + 1)) - 1;
+    static constexpr uint32_t BUCKETS = (MAX_MAGNITUDE - SUB_BITS + 2) * SUB_BUCKETS;
+
+    static uint32_t bucketOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<uint32_t>(value);
+        }
+        const uint32_t magnitude = 63u - static_cast<uint32_t>(__builtin_clzll(value));
+        const uint32_t shift = magnitude - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<uint32_t>(value >> shift) - SUB_BUCKETS;
+    }
+
+    static uint64_t highestValueOf(uint32_t bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+        const uint32_t shift = bucket / SUB_BUCKETS - 1;
+        const uint64_t first = static_cast<uint64_t>(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return first + (uint64_t{1} << shift) - 1;
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKETS> m_counts;
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// Named latency histograms, one per stage of the cone pipeline. Histograms
+// are added before processing starts and keep their address afterwards.
+class StageLatencies
+{
+  public:
+    StageLatencies() = default;
+    StageLatencies(const StageLatencies &) = delete;
+    StageLatencies &operator=(const StageLatencies &) = delete;
+
+    LatencyHistogram &add(const std::string &name)
+    {
+        m_stages.emplace_back(name, std::unique_ptr<LatencyHistogram>(new LatencyHistogram));
+        return *m_stages.back().second;
+    }
+
+    // Count, p50, p90, p99 and max in microseconds per stage.
+    void report(std::ostream &out) const
+    {
+        out << "latency [us]:        count       p50       p90       p99       max" << std::endl;
+        for (const std::pair<std::string, std::unique_ptr<LatencyHistogram>> &stage : m_stages)
+        {
+            const LatencyHistogram &histogram = *stage.second;
+            out << "  " << std::left << std::setw(12) << stage.first << std::right << std::setw(11) << histogram.count() << std::fixed << std::setprecision(1)
+                << std::setw(10) << microseconds(histogram.percentile(50)) << std::setw(10) << microseconds(histogram.percentile(90)) << std::setw(10)
+                << microseconds(histogram.percentile(99)) << std::setw(10) << microseconds(histogram.max()) << std::defaultfloat << std::endl;
+        }
+    }
+
+  private:
+    static double microseconds(uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) / 1000.0;
+    }
+
+  private:
+    std::vector<std::pair<std::string, std::unique_ptr<LatencyHistogram>>> m_stages{};
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MASK_MORPHOLOGY_HPP
+#define MASK_MORPHOLOGY_HPP
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// Dilation and erosion of 8-bit masks with cv::dilate and cv::erode and a
+// structuring element that is built once. dst has to be allocated with the
+// size and type of src so that OpenCV writes into it instead of reallocating
+// it. The filters still allocate their own scratch rows on every call, so
+// this is only the reference path of --byte-masks; the allocation-free one
+// is PackedMorphology. Pixels outside src are ignored, OpenCV's default
+// border for morphology, as long as src is not part of a larger cv::Mat.
+class MaskMorphology
+{
+  public:
+    // The anchor is the centre of the element.
+    explicit MaskMorphology(const cv::Mat &element)
+        : m_element(element)
+    {
+    }
+
+    void dilate(const cv::Mat &src, cv::Mat &dst) const
+    {
+        cv::dilate(src, dst, m_element);
+    }
+
+    void erode(const cv::Mat &src, cv::Mat &dst) const
+    {
+        cv::erode(src, dst, m_element);
+    }
+
+  private:
+    cv::Mat m_element;
+};
+
+// Gaussian blur of an 8-bit mask with cv::GaussianBlur (sigma <= 0 derives
+// it from the size) into a preallocated dst of the size and type of src.
+class MaskSmoothing
+{
+  public:
+    MaskSmoothing(int32_t kernelSize, double sigma)
+        : m_size(kernelSize, kernelSize)
+        , m_sigma(sigma)
+    {
+    }
+
+    int32_t kernelSize() const { return m_size.width; }
+    double sigma() const { return m_sigma; }
+
+    void apply(const cv::Mat &src, cv::Mat &dst) const
+    {
+        cv::GaussianBlur(src, dst, m_size, m_sigma);
+    }
+
+  private:
+    cv::Size m_size;
+    double m_sigma;
+};
+
+#endif
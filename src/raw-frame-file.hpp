@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAW_FRAME_FILE_HPP
+#define RAW_FRAME_FILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+
+// Captures pass 2 GiB in under a minute; on 32-bit boards this needs the
+// 64-bit file interface, which CMakeLists.txt selects for every source.
+static_assert(sizeof(off_t) >= sizeof(int64_t), "raw frame files need a 64-bit off_t; build with -D_FILE_OFFSET_BITS=64");
+
+// Raw frame files hold the frames of the shared memory exactly as they were
+// seen, together with their sample time stamps. The file starts with one page
+// holding a RawFrameFileHeader; every frame follows as a record of a whole
+// number of pages: a 64 byte RawFrameRecordHeader and the pixels right after
+// it. Records are only ever appended, so a file cut short by a crash loses at
+// most its last record. Pages are 4096 bytes on every platform and all numbers
+// are little-endian, so files move freely between amd64 and armv7 boards.
+namespace rawframe
+{
+constexpr uint32_t PAGE_SIZE{4096};
+constexpr uint32_t RECORD_HEADER_SIZE{64};
+constexpr uint32_t VERSION{1};
+constexpr char MAGIC[8]{'G', '1', '0', 'F', 'R', 'A', 'M', 'E'};
+
+inline uint64_t recordSize(uint32_t width, uint32_t height, uint32_t bytesPerPixel)
+{
+    const uint64_t bytes{RECORD_HEADER_SIZE + static_cast<uint64_t>(width) * height * bytesPerPixel};
+    return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+} // namespace rawframe
+
+struct RawFrameFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    uint64_t recordSize;
+};
+
+struct RawFrameRecordHeader
+{
+    int64_t sampleTimeStamp;
+    uint64_t index;
+    uint8_t reserved[rawframe::RECORD_HEADER_SIZE - 2 * sizeof(uint64_t)];
+};
+static_assert(sizeof(RawFrameRecordHeader) == rawframe::RECORD_HEADER_SIZE, "the pixels follow the record header directly");
+
+// Appends frames to a raw frame file. An existing file with the same frame
+// size is continued; a torn record at its end is cut off first. Each frame is
+// written with a single writev() straight from the caller's buffer.
+class RawFrameWriter
+{
+  public:
+    RawFrameWriter(const std::string &path, uint32_t width, uint32_t height, uint32_t bytesPerPixel = 4)
+        : m_path(path)
+        , m_frameSize(static_cast<uint64_t>(width) * height * bytesPerPixel)
+        , m_recordSize(rawframe::recordSize(width, height, bytesPerPixel))
+    {
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (-1 == m_fd)
+        {
+            std::cerr << "[RawFrameWriter] Failed to open '" << path << "': " << ::strerror(errno) << std::endl;
+            return;
+        }
+
+        RawFrameFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, rawframe::MAGIC, sizeof(header.magic));
+        header.version = rawframe::VERSION;
+        header.width = width;
+        header.height = height;
+        header.bytesPerPixel = bytesPerPixel;
+        header.recordSize = m_recordSize;
+
+        struct stat status;
+        if (0 != ::fstat(m_fd, &status))
+        {
+            fail("read the size of");
+            return;
+        }
+        const uint64_t size{static_cast<uint64_t>(status.st_size)};
+        if (0 == size)
+        {
+            char page[rawframe::PAGE_SIZE];
+            std::memset(page, 0, sizeof(page));
+            std::memcpy(page, &header, sizeof(header));
+            if (static_cast<ssize_t>(sizeof(page)) != ::write(m_fd, page, sizeof(page)))
+            {
+                fail("write the header of");
+                return;
+            }
+        }
+        else
+        {
+            RawFrameFileHeader existing;
+            if ((static_cast<ssize_t>(sizeof(existing)) != ::pread(m_fd, &existing, sizeof(existing), 0)) || (0 != std::memcmp(&existing, &header, sizeof(header))))
+            {
+                std::cerr << "[RawFrameWriter] '" << path << "' is not a raw frame file of " << width << "x" << height << " frames." << std::endl;
+                close();
+                return;
+            }
+            m_frames = (size - rawframe::PAGE_SIZE) / m_recordSize;
+            if (0 != ::ftruncate(m_fd, static_cast<off_t>(rawframe::PAGE_SIZE + m_frames * m_recordSize)))
+            {
+                fail("cut the torn record of");
+                return;
+            }
+        }
+        if (static_cast<off_t>(-1) == ::lseek(m_fd, 0, SEEK_END))
+        {
+            fail("seek to the end of");
+        }
+    }
+
+    RawFrameWriter(const RawFrameWriter &) = delete;
+    RawFrameWriter &operator=(const RawFrameWriter &) = delete;
+
+    ~RawFrameWriter()
+    {
+        close();
+    }
+
+    bool valid() const { return -1 != m_fd; }
+
+    uint64_t frames() const { return m_frames; }
+
+    uint64_t frameSize() const { return m_frameSize; }
+
+    // Appends one frame of the size given at construction.
+    bool append(int64_t sampleTimeStamp, const void *pixels)
+    {
+        if (!valid())
+        {
+            return false;
+        }
+        static const uint8_t padding[rawframe::PAGE_SIZE]{};
+        RawFrameRecordHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.sampleTimeStamp = sampleTimeStamp;
+        header.index = m_frames;
+
+        struct iovec parts[3];
+        parts[0].iov_base = &header;
+        parts[0].iov_len = sizeof(header);
+        parts[1].iov_base = const_cast<void *>(pixels);
+        parts[1].iov_len = m_frameSize;
+        parts[2].iov_base = const_cast<uint8_t *>(padding);
+        parts[2].iov_len = m_recordSize - sizeof(header) - m_frameSize;
+        if (static_cast<ssize_t>(m_recordSize) != ::writev(m_fd, parts, 3))
+        {
+            fail("append to");
+            return false;
+        }
+        m_frames++;
+        return true;
+    }
+
+  private:
+    void fail(const char *what)
+    {
+        std::cerr << "[RawFrameWriter] Failed to " << what << " '" << m_path << "': " << ::strerror(errno) << std::endl;
+        close();
+    }
+
+    void close()
+    {
+        if (-1 != m_fd)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+  private:
+    std::string m_path;
+    uint64_t m_frameSize;
+    uint64_t m_recordSize;
+    int m_fd{-1};
+    uint64_t m_frames{0};
+};
+
+// Replays a raw frame file by mapping it into memory; frames are served as
+// pointers into the mapping, so nothing is copied until the pipeline copies
+// the region it processes, as it does from the shared memory. The whole file
+// has to fit into the address space, which limits files to about 2 GB on
+// 32-bit boards.
+class RawFrameReplay
+{
+  public:
+    explicit RawFrameReplay(const std::string &path)
+    {
+        const int fd{::open(path.c_str(), O_RDONLY)};
+        if (-1 == fd)
+        {
+            std::cerr << "[RawFrameReplay] Failed to open '" << path << "': " << ::strerror(errno) << std::endl;
+            return;
+        }
+        struct stat status;
+        const uint64_t size{(0 == ::fstat(fd, &status)) ? static_cast<uint64_t>(status.st_size) : 0};
+        if (size > std::numeric_limits<std::size_t>::max())
+        {
+            std::cerr << "[RawFrameReplay] '" << path << "' does not fit into the address space." << std::endl;
+        }
+        else if (size >= rawframe::PAGE_SIZE)
+        {
+            m_size = static_cast<std::size_t>(size);
+            void *mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED != mapping)
+            {
+                m_mapping = static_cast<const uint8_t *>(mapping);
+                ::madvise(mapping, m_size, MADV_SEQUENTIAL);
+            }
+            else
+            {
+                std::cerr << "[RawFrameReplay] Failed to map '" << path << "': " << ::strerror(errno) << std::endl;
+            }
+        }
+        ::close(fd);
+
+        if (nullptr != m_mapping)
+        {
+            std::memcpy(&m_header, m_mapping, sizeof(m_header));
+            if ((0 != std::memcmp(m_header.magic, rawframe::MAGIC, sizeof(m_header.magic))) || (rawframe::VERSION != m_header.version) ||
+                (m_header.recordSize != rawframe::recordSize(m_header.width, m_header.height, m_header.bytesPerPixel)))
+            {
+                std::cerr << "[RawFrameReplay] '" << path << "' is not a raw frame file." << std::endl;
+                unmap();
+                return;
+            }
+            m_frames = static_cast<std::size_t>((m_size - rawframe::PAGE_SIZE) / m_header.recordSize);
+        }
+    }
+
+    RawFrameReplay(const RawFrameReplay &) = delete;
+    RawFrameReplay &operator=(const RawFrameReplay &) = delete;
+
+    ~RawFrameReplay()
+    {
+        unmap();
+    }
+
+    bool valid() const { return nullptr != m_mapping; }
+
+    std::size_t frames() const { return m_frames; }
+    uint32_t width() const { return m_header.width; }
+    uint32_t height() const { return m_header.height; }
+    uint32_t bytesPerPixel() const { return m_header.bytesPerPixel; }
+
+    int64_t sampleTimeStamp(std::size_t i) const
+    {
+        int64_t sampleTimeStamp;
+        std::memcpy(&sampleTimeStamp, record(i), sizeof(sampleTimeStamp));
+        return sampleTimeStamp;
+    }
+
+    // Pixels of frame i in the layout of the shared memory.
+    const char *data(std::size_t i) const
+    {
+        return reinterpret_cast<const char *>(record(i) + rawframe::RECORD_HEADER_SIZE);
+    }
+
+  private:
+    const uint8_t *record(std::size_t i) const
+    {
+        return m_mapping + rawframe::PAGE_SIZE + i * m_header.recordSize;
+    }
+
+    void unmap()
+    {
+        if (nullptr != m_mapping)
+        {
+            ::munmap(const_cast<uint8_t *>(m_mapping), m_size);
+            m_mapping = nullptr;
+        }
+    }
+
+  private:
+    const uint8_t *m_mapping{nullptr};
+    std::size_t m_size{0};
+    RawFrameFileHeader m_header{};
+    std::size_t m_frames{0};
+};
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESULT_WRITER_HPP
+#define RESULT_WRITER_HPP
+
+#include "cluon-complete-v0.0.127.hpp"
+#include "spsc-ring.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Steering angle of one frame as it is handed to the ResultWriter.
+struct SteeringResult
+{
+    int64_t sampleTimeStamp;
+    double steeringAngle;
+};
+
+// Destination of the formatted results; write() is only called from the
+// thread of the ResultWriter and gets whole lines.
+class ResultSink
+{
+  public:
+    virtual ~ResultSink() = default;
+    virtual bool valid() const = 0;
+    virtual bool write(const char *data, std::size_t size) = 0;
+};
+
+// Writes to a file descriptor: stdout, or a file that is appended to.
+class FileResultSink : public ResultSink
+{
+  public:
+    // Writes to stdout.
+    FileResultSink()
+        : m_path("stdout")
+        , m_fd(STDOUT_FILENO)
+        , m_owned(false)
+    {
+    }
+
+    explicit FileResultSink(const std::string &path)
+        : m_path(path)
+        , m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH))
+        , m_owned(true)
+    {
+        if (-1 == m_fd)
+        {
+            std::cerr << "[FileResultSink] Failed to open '" << path << "': " << ::strerror(errno) << std::endl;
+        }
+    }
+
+    FileResultSink(const FileResultSink &) = delete;
+    FileResultSink &operator=(const FileResultSink &) = delete;
+
+    ~FileResultSink() override
+    {
+        if (m_owned && (-1 != m_fd))
+        {
+            ::close(m_fd);
+        }
+    }
+
+    bool valid() const override { return -1 != m_fd; }
+
+    bool write(const char *data, std::size_t size) override
+    {
+        while (0 < size)
+        {
+            const ssize_t written{::write(m_fd, data, size)};
+            if (0 > written)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                std::cerr << "[FileResultSink] Failed to write to '" << m_path << "': " << ::strerror(errno) << std::endl;
+                return false;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+  private:
+    std::string m_path;
+    int m_fd;
+    bool m_owned;
+};
+
+// Writes into a byte ring in a shared memory area that other processes on the
+// board can follow. The area starts with a ResultRingHeader; the bytes follow.
+// The total number of bytes ever written grows monotonically, so a reader
+// keeps its own count, waits for the notification, and copies the bytes from
+// its count up to the total while holding the lock; when the total is more
+// than the capacity ahead, the reader fell behind and lost bytes.
+struct ResultRingHeader
+{
+    uint64_t written;
+    uint64_t capacity;
+};
+
+class SharedMemoryResultSink : public ResultSink
+{
+  public:
+    SharedMemoryResultSink(const std::string &name, uint32_t capacity)
+        : m_sharedMemory(new cluon::SharedMemory{name, static_cast<uint32_t>(sizeof(ResultRingHeader)) + capacity})
+        , m_capacity(capacity)
+    {
+        if (valid())
+        {
+            m_sharedMemory->lock();
+            ResultRingHeader header{0, m_capacity};
+            std::memcpy(m_sharedMemory->data(), &header, sizeof(header));
+            m_sharedMemory->unlock();
+        }
+        else
+        {
+            std::cerr << "[SharedMemoryResultSink] Failed to create shared memory '" << name << "'." << std::endl;
+        }
+    }
+
+    bool valid() const override { return (0 < m_capacity) && m_sharedMemory->valid(); }
+
+    bool write(const char *data, std::size_t size) override
+    {
+        m_sharedMemory->lock();
+        ResultRingHeader header;
+        std::memcpy(&header, m_sharedMemory->data(), sizeof(header));
+        char *ring{m_sharedMemory->data() + sizeof(header)};
+        // Only the newest bytes survive a batch that is larger than the ring
+        const std::size_t skipped{(size > m_capacity) ? size - m_capacity : 0};
+        header.written += skipped;
+        data += skipped;
+        size -= skipped;
+
+        const std::size_t offset{static_cast<std::size_t>(header.written % m_capacity)};
+        const std::size_t first{std::min<std::size_t>(size, m_capacity - offset)};
+        std::memcpy(ring + offset, data, first);
+        std::memcpy(ring, data + first, size - first);
+        header.written += size;
+        std::memcpy(m_sharedMemory->data(), &header, sizeof(header));
+        m_sharedMemory->unlock();
+        m_sharedMemory->notifyAll();
+        return true;
+    }
+
+  private:
+    std::unique_ptr<cluon::SharedMemory> m_sharedMemory;
+    uint64_t m_capacity;
+};
+
+// Takes the results off the frame loop: the thread that produces them only
+// pushes a SteeringResult into a lock-free ring, and a background thread
+// formats them as "group_10;<sampleTimeStamp>;<steeringAngle>" lines and
+// writes them in batches. The writer drains the ring every flushInterval and
+// writes the buffered lines once the oldest of them waited maxLatency (0
+// writes on every drain) or the buffer is full. When the ring is full, a
+// result is dropped rather than blocking the frame loop. Results are pushed
+// from exactly one thread at a time.
+class ResultWriter
+{
+  public:
+    ResultWriter(std::unique_ptr<ResultSink> &&sink, std::chrono::microseconds flushInterval, std::chrono::microseconds maxLatency,
+                 std::size_t capacity = 1024)
+        : m_sink(std::move(sink))
+        , m_flushInterval(flushInterval)
+        , m_maxLatency(maxLatency)
+        , m_results(capacity)
+        , m_buffer(BUFFER_SIZE)
+        , m_mutex()
+        , m_wakeUp()
+        , m_thread()
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+
+    ~ResultWriter()
+    {
+        stop();
+    }
+
+    // Producer side; never blocks and never allocates.
+    void push(int64_t sampleTimeStamp, double steeringAngle)
+    {
+        if (!m_results.push(SteeringResult{sampleTimeStamp, steeringAngle}))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Writes every result pushed so far and ends the writer thread.
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_wakeUp.notify_one();
+            m_thread.join();
+        }
+    }
+
+    void report(std::ostream &out) const
+    {
+        out << "output: " << m_written.load() << " results in " << m_writes.load() << " writes, " << m_dropped.load() << " dropped" << std::endl;
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t BUFFER_SIZE{64 * 1024};
+    // group_10;, 20 digits and a sign, ;, %g of a double and the newline
+    static constexpr std::size_t MAX_LINE{64};
+
+    void run()
+    {
+        std::size_t used{0};
+        uint64_t lines{0};
+        Clock::time_point oldest{};
+        bool stopping{false};
+        while (!stopping)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeUp.wait_for(lock, m_flushInterval, [this]() { return m_stopping; });
+                stopping = m_stopping;
+            }
+
+            SteeringResult result;
+            while (m_results.pop(result))
+            {
+                if (BUFFER_SIZE - used < MAX_LINE)
+                {
+                    flush(used, lines);
+                }
+                if (0 == used)
+                {
+                    oldest = Clock::now();
+                }
+                used += format(result, m_buffer.data() + used);
+                lines++;
+            }
+            if ((0 < used) && (stopping || (Clock::now() - oldest >= m_maxLatency)))
+            {
+                flush(used, lines);
+            }
+        }
+    }
+
+    void flush(std::size_t &used, uint64_t &lines)
+    {
+        if (m_sink->write(m_buffer.data(), used))
+        {
+            m_written.fetch_add(lines, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_dropped.fetch_add(lines, std::memory_order_relaxed);
+        }
+        m_writes.fetch_add(1, std::memory_order_relaxed);
+        used = 0;
+        lines = 0;
+    }
+
+    // Same text as std::cout << "group_10;" << sampleTimeStamp << ";" << steeringAngle
+    // with the default stream format; the time stamp is converted by hand as it
+    // is the longer part, the angle with %g exactly like the stream does it.
+    static std::size_t format(const SteeringResult &result, char *line)
+    {
+        static const char PREFIX[]{"group_10;"};
+        char *out{line};
+        std::memcpy(out, PREFIX, sizeof(PREFIX) - 1);
+        out += sizeof(PREFIX) - 1;
+
+        uint64_t value{static_cast<uint64_t>(result.sampleTimeStamp)};
+        if (0 > result.sampleTimeStamp)
+        {
+            *out++ = '-';
+            value = 0 - value;
+        }
+        char digits[20];
+        std::size_t count{0};
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (0 < value);
+        while (0 < count)
+        {
+            *out++ = digits[--count];
+        }
+
+        *out++ = ';';
+        const int angle{std::snprintf(out, MAX_LINE - static_cast<std::size_t>(out - line) - 1, "%g", result.steeringAngle)};
+        out += (0 < angle) ? angle : 0;
+        *out++ = '\n';
+        return static_cast<std::size_t>(out - line);
+    }
+
+  private:
+    std::unique_ptr<ResultSink> m_sink;
+    const std::chrono::microseconds m_flushInterval;
+    const std::chrono::microseconds m_maxLatency;
+    SpscRing<SteeringResult> m_results;
+    std::vector<char> m_buffer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    bool m_stopping{false};
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_writes{0};
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two; head and tail are
+// padded apart onto separate cache lines so producer and consumer do not
+// share a line (padding rather than alignas, as C++14 has no over-aligned new).
+template <typename T>
+class SpscRing
+{
+  public:
+    explicit SpscRing(std::size_t capacity)
+        : m_mask(roundUp(capacity) - 1)
+        , m_buffer(roundUp(capacity))
+    {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer side; returns false when the ring is full.
+    bool push(const T &value)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+        {
+            return false;
+        }
+        m_buffer[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false when the ring is empty.
+    bool pop(T &value)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = m_buffer[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of entries; exact only when called from the producer or consumer.
+    std::size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return m_mask + 1; }
+
+  private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t capacity = 1;
+        while (capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+  private:
+    const std::size_t m_mask;
+    std::vector<T> m_buffer;
+    char m_padding0[CACHE_LINE]{};
+    std::atomic<std::size_t> m_head{0};
+    char m_padding1[CACHE_LINE]{};
+    std::atomic<std::size_t> m_tail{0};
+    char m_padding2[CACHE_LINE]{};
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STEERING_GEOMETRY_HPP
+#define STEERING_GEOMETRY_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#define PI 3.1415926535
+#define X_POSITION_OF_CAR 320
+#define Y_POSITION_OF_CAR 480
+
+// The steering angle from the bird's-eye centroids of the yellow and the blue
+// cones. Every function reads a plain array of centroids, such as the data of
+// a reserved std::vector or a fixed array, never sorts or copies it and does
+// not allocate. The arithmetic is the same as in the original version, which
+// sorted the cones and used std::pow and std::sqrt, down to the float and
+// double roundings, so the angle buckets come out identical.
+
+// The cone closest to the car, the one lowest in the view, and the next one in a single pass. Cones at
+// the same height keep their order, as with the insertion sort std::sort uses for a few cones.
+inline void nearestConePair(const cv::Point2f *cones, std::size_t count, cv::Point2f &nearest, cv::Point2f &next)
+{
+    const bool swapped = cones[1].y > cones[0].y;
+    nearest = cones[swapped ? 1 : 0];
+    next = cones[swapped ? 0 : 1];
+    for (std::size_t i = 2; i < count; i++)
+    {
+        const cv::Point2f &cone = cones[i];
+        if (cone.y > next.y)
+        {
+            const bool closest = cone.y > nearest.y;
+            next = closest ? nearest : cone;
+            nearest = closest ? cone : nearest;
+        }
+    }
+}
+
+// The direction of the road from the two nearest of at least two cones, in degrees from the right x
+// axis; 90 when the nearest cone is 200 pixels or more away from the car, or the road is within
+// 30 degrees of straight ahead.
+inline double angleOfRoad(const cv::Point2f *cones, std::size_t count)
+{
+    cv::Point2f nearest;
+    cv::Point2f next;
+    nearestConePair(cones, count, nearest, next);
+
+    // sqrt(d) < 200 holds exactly when d < 200 * 200
+    const float dx = nearest.x - X_POSITION_OF_CAR;
+    const float dy = nearest.y - Y_POSITION_OF_CAR;
+    const double squaredDistance = static_cast<double>(dx) * dx + static_cast<double>(dy) * dy;
+    if (!(squaredDistance < 200.0 * 200.0))
+    {
+        return 90;
+    }
+
+    // Getting the angle in radians, converting it to degrees and measuring it from the right x axis
+    const double radians = std::atan2(nearest.y - next.y, nearest.x - next.x);
+    const double adjusted = 180 - radians * 180 / PI;
+    return ((adjusted > 60) && (adjusted < 120)) ? 90 : adjusted;
+}
+
+// The steering angle from the cones of both colours; a colour is used when it has at least two cones.
+inline double steeringAngle(const cv::Point2f *yellow, std::size_t yellowCount, const cv::Point2f *blue, std::size_t blueCount)
+{
+    const bool useYellow = 2 <= yellowCount;
+    const bool useBlue = 2 <= blueCount;
+    double roadAngle = 90;
+    if (useYellow && useBlue)
+    {
+        // Taking the mean value of the found angles
+        roadAngle = (angleOfRoad(yellow, yellowCount) + angleOfRoad(blue, blueCount)) / 2;
+    }
+    else if (useYellow || useBlue)
+    {
+        roadAngle = useYellow ? angleOfRoad(yellow, yellowCount) : angleOfRoad(blue, blueCount);
+    }
+
+    // after reverse engingeering the groundsteering requests we find out that the ground steering request that are less than 80 degrees means we can send ground steering request
+    // Getting a value between 0 and 0.6 based on the angle
+    return ((roadAngle < 90) || (roadAngle > 90)) ? (roadAngle * 0.003333) - 0.3 : 0.0;
+}
+
+#endif
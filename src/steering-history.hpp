@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STEERING_HISTORY_HPP
+#define STEERING_HISTORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The most recent ground steering requests keyed by their sample time stamps,
+// so that every frame is compared with the steering at the time the frame was
+// taken rather than whatever arrived last. One thread appends samples in time
+// order while any number of threads look up values without locks: the ring
+// holds twice the searched window and a reader retries, like a seqlock, when
+// the writer lapped the entries it read.
+class SteeringHistory
+{
+  public:
+    // samples is the number of recent samples that can be looked up.
+    explicit SteeringHistory(std::size_t samples)
+        : m_window(samples < 2 ? 2 : samples)
+        , m_mask(roundUp(2 * m_window) - 1)
+        , m_entries(m_mask + 1)
+    {
+    }
+
+    SteeringHistory(const SteeringHistory &) = delete;
+    SteeringHistory &operator=(const SteeringHistory &) = delete;
+
+    // Writer side.
+    void push(int64_t sampleTimeStamp, double groundSteering)
+    {
+        const uint64_t i = m_published.load(std::memory_order_relaxed);
+        m_claimed.store(i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Entry &entry = m_entries[i & m_mask];
+        entry.sampleTimeStamp.store(sampleTimeStamp, std::memory_order_relaxed);
+        entry.groundSteering.store(groundSteering, std::memory_order_relaxed);
+        m_published.store(i + 1, std::memory_order_release);
+    }
+
+    std::size_t size() const
+    {
+        const uint64_t published = m_published.load(std::memory_order_acquire);
+        return static_cast<std::size_t>(published < m_window ? published : m_window);
+    }
+
+    // Ground steering at the given time, linearly interpolated between the
+    // samples before and after it. After the newest sample its value is held;
+    // before the very first sample the steering is 0 as nothing was requested.
+    double at(int64_t sampleTimeStamp) const
+    {
+        while (true)
+        {
+            const uint64_t end = m_published.load(std::memory_order_acquire);
+            if (0 == end)
+            {
+                return 0.0;
+            }
+            const uint64_t begin = (end > m_window) ? end - m_window : 0;
+
+            // First sample at or after the time stamp
+            uint64_t lo = begin;
+            uint64_t hi = end;
+            while (lo < hi)
+            {
+                const uint64_t mid = lo + (hi - lo) / 2;
+                if (timeStampOf(mid) < sampleTimeStamp)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            double value;
+            if (end == lo)
+            {
+                value = valueOf(end - 1);
+            }
+            else if ((begin == lo) || (timeStampOf(lo) == sampleTimeStamp))
+            {
+                const bool beforeFirst = (0 == lo) && (timeStampOf(lo) != sampleTimeStamp);
+                value = beforeFirst ? 0.0 : valueOf(lo);
+            }
+            else
+            {
+                const int64_t t0 = timeStampOf(lo - 1);
+                const int64_t t1 = timeStampOf(lo);
+                const double v0 = valueOf(lo - 1);
+                const double v1 = valueOf(lo);
+                value = (t1 > t0) ? v0 + (v1 - v0) * static_cast<double>(sampleTimeStamp - t0) / static_cast<double>(t1 - t0) : v1;
+            }
+
+            // The values are only valid if no entry from begin on was overwritten meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_claimed.load(std::memory_order_relaxed) <= begin + m_mask + 1)
+            {
+                return value;
+            }
+        }
+    }
+
+  private:
+    struct Entry
+    {
+        std::atomic<int64_t> sampleTimeStamp{0};
+        std::atomic<double> groundSteering{0.0};
+    };
+
+    int64_t timeStampOf(uint64_t i) const
+    {
+        return m_entries[i & m_mask].sampleTimeStamp.load(std::memory_order_relaxed);
+    }
+
+    double valueOf(uint64_t i) const
+    {
+        return m_entries[i & m_mask].groundSteering.load(std::memory_order_relaxed);
+    }
+
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t capacity = 1;
+        while (capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+  private:
+    const std::size_t m_window;
+    const std::size_t m_mask;
+    std::vector<Entry> m_entries;
+    std::atomic<uint64_t> m_claimed{0};
+    std::atomic<uint64_t> m_published{0};
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STEERING_PUBLISHER_HPP
+#define STEERING_PUBLISHER_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <string>
+
+// Encodes a GroundSteeringRequest in its Envelope with the OD4 header into a
+// fixed buffer, byte for byte like cluon::serializeEnvelope() does, but
+// without the string streams and strings that OD4Session::send() allocates
+// for every message. The dataType is opendlv::proxy::GroundSteeringRequest::ID().
+class GroundSteeringEncoder
+{
+  public:
+    // Header, dataType and senderStamp plus three time stamps and the float
+    static constexpr std::size_t MAX_SIZE{128};
+
+    explicit GroundSteeringEncoder(int32_t dataType)
+        : m_dataType(dataType)
+        , m_buffer()
+    {
+    }
+
+    // Encodes the message; returns the number of bytes at data().
+    std::size_t encode(float groundSteering, int64_t sentMicroseconds, int64_t sampleMicroseconds, uint32_t senderStamp)
+    {
+        m_size = HEADER_SIZE;
+        putKey(1, VARINT);
+        putVarInt(zigZag(m_dataType));
+
+        // serializedData: the GroundSteeringRequest with its only field
+        putKey(2, LENGTH_DELIMITED);
+        putVarInt(5);
+        putKey(1, FOUR_BYTES);
+        uint32_t bits;
+        std::memcpy(&bits, &groundSteering, sizeof(bits));
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            m_buffer[m_size++] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+
+        putTimeStamp(3, sentMicroseconds);
+        putTimeStamp(4, 0);
+        putTimeStamp(5, sampleMicroseconds);
+        putKey(6, VARINT);
+        putVarInt(senderStamp);
+
+        // 0x0D 0xA4 and the payload length as three little-endian bytes
+        const std::size_t length{m_size - HEADER_SIZE};
+        m_buffer[0] = 0x0D;
+        m_buffer[1] = 0xA4;
+        m_buffer[2] = static_cast<uint8_t>(length);
+        m_buffer[3] = static_cast<uint8_t>(length >> 8);
+        m_buffer[4] = static_cast<uint8_t>(length >> 16);
+        return m_size;
+    }
+
+    const uint8_t *data() const { return m_buffer; }
+
+  private:
+    static constexpr std::size_t HEADER_SIZE{5};
+    static constexpr uint8_t VARINT{0};
+    static constexpr uint8_t FOUR_BYTES{5};
+    static constexpr uint8_t LENGTH_DELIMITED{2};
+
+    static uint64_t zigZag(int32_t v)
+    {
+        return static_cast<uint32_t>((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+    }
+
+    static std::size_t varIntSize(uint64_t v)
+    {
+        std::size_t size{1};
+        while (0x7f < v)
+        {
+            v >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    void putVarInt(uint64_t v)
+    {
+        while (0x7f < v)
+        {
+            m_buffer[m_size++] = static_cast<uint8_t>((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        m_buffer[m_size++] = static_cast<uint8_t>(v);
+    }
+
+    void putKey(uint32_t field, uint8_t type)
+    {
+        putVarInt((field << 3) | type);
+    }
+
+    // A nested cluon::data::TimeStamp of seconds and microseconds
+    void putTimeStamp(uint32_t field, int64_t microseconds)
+    {
+        const uint64_t seconds{zigZag(static_cast<int32_t>(microseconds / 1000000))};
+        const uint64_t fraction{zigZag(static_cast<int32_t>(microseconds % 1000000))};
+        putKey(field, LENGTH_DELIMITED);
+        putVarInt(2 + varIntSize(seconds) + varIntSize(fraction));
+        putKey(1, VARINT);
+        putVarInt(seconds);
+        putKey(2, VARINT);
+        putVarInt(fraction);
+    }
+
+  private:
+    const int32_t m_dataType;
+    uint8_t m_buffer[MAX_SIZE];
+    std::size_t m_size{0};
+};
+
+// Publishes the calculated steering as GroundSteeringRequest to the OD4
+// session with the given CID, so controllers get it over the middleware. It
+// sends from a socket of its own, as OD4Session offers no way to send bytes
+// that are already encoded; the OD4Session of this process therefore receives
+// these messages too and has to skip the own senderStamp. Used from one
+// thread at a time.
+class SteeringPublisher
+{
+  public:
+    SteeringPublisher(uint16_t cid, int32_t dataType, uint32_t senderStamp)
+        : m_senderStamp(senderStamp)
+        , m_address()
+        , m_encoder(dataType)
+    {
+        std::memset(&m_address, 0, sizeof(m_address));
+        m_address.sin_family = AF_INET;
+        m_address.sin_port = htons(OD4_PORT);
+        m_address.sin_addr.s_addr = ::inet_addr(("225.0.0." + std::to_string(cid)).c_str());
+        m_socket = ::socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (-1 == m_socket)
+        {
+            std::cerr << "[SteeringPublisher] Failed to create socket: " << ::strerror(errno) << std::endl;
+        }
+    }
+
+    SteeringPublisher(const SteeringPublisher &) = delete;
+    SteeringPublisher &operator=(const SteeringPublisher &) = delete;
+
+    ~SteeringPublisher()
+    {
+        if (-1 != m_socket)
+        {
+            ::close(m_socket);
+        }
+    }
+
+    bool valid() const { return -1 != m_socket; }
+
+    uint32_t senderStamp() const { return m_senderStamp; }
+
+    void publish(float groundSteering, int64_t sentMicroseconds, int64_t sampleMicroseconds)
+    {
+        const std::size_t size{m_encoder.encode(groundSteering, sentMicroseconds, sampleMicroseconds, m_senderStamp)};
+        const ssize_t sent{::sendto(m_socket, m_encoder.data(), size, 0, reinterpret_cast<const struct sockaddr *>(&m_address), sizeof(m_address))};
+        if (static_cast<ssize_t>(size) == sent)
+        {
+            m_published.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void report(std::ostream &out) const
+    {
+        out << "publish: " << m_published.load() << " GroundSteeringRequest with senderStamp " << m_senderStamp << ", " << m_failed.load() << " failed" << std::endl;
+    }
+
+  private:
+    static constexpr uint16_t OD4_PORT{12175};
+
+  private:
+    const uint32_t m_senderStamp;
+    struct sockaddr_in m_address;
+    int m_socket{-1};
+    GroundSteeringEncoder m_encoder;
+    std::atomic<uint64_t> m_published{0};
+    std::atomic<uint64_t> m_failed{0};
+};
+
+#endif
@@ -21,300 +21,60 @@
 // Include the OpenDLV Standard Message Set that contains messages that are usually exchanged for automotive or robotic applications
 #include "opendlv-standard-message-set.hpp"
 
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#include "allocation-counter.hpp"
+#include "birdeye-renderer.hpp"
+#include "cone-colour-classifier.hpp"
+#include "cone-pipeline.hpp"
+#include "frame-pipeline.hpp"
+#include "frame-scheduler.hpp"
+#include "frame-workspace.hpp"
+#include "latency-histogram.hpp"
+#include "raw-frame-file.hpp"
+#include "result-writer.hpp"
+#include "steering-history.hpp"
+#include "steering-publisher.hpp"
+#include "worker-pool.hpp"
+
 // Include the GUI and image processing header files from OpenCV
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <fstream> //used for file handling
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
-#include <mutex>
-#define PI 3.1415926535
-#define X_POSITION_OF_CAR 320
-#define Y_POSITION_OF_CAR 480
-
-cv::Mat getMatrix()
-{
-
-    cv::Point2f src_vertices[4];
-    src_vertices[0] = cv::Point(207, 285);
-    src_vertices[1] = cv::Point(364, 285);
-    src_vertices[2] = cv::Point(476, 350);
-    src_vertices[3] = cv::Point(89, 353);
-
-    // How the vertices should be mapped on the destination image
-    //
-    //    [0]   [1]
-    //
-    //    [2]   [3]
-    //
-
-    cv::Point2f dst_vertices[4];
-
-    // CLOSE PERSPECTIVE
-    dst_vertices[0] = cv::Point(125, 130);
-    dst_vertices[1] = cv::Point(390, 130);
-    dst_vertices[2] = cv::Point(390, 395);
-    dst_vertices[3] = cv::Point(125, 395);
-
-    cv::Mat M = getPerspectiveTransform(src_vertices, dst_vertices);
-    return M;
-}
-
-std::vector<cv::Point2f> convertPoints(std::vector<cv::Point2f> coordinates)
-{
-
-    cv::Mat M = getMatrix();
-    std::vector<cv::Point2f> dst_points;
-
-    // Changing perspective to birds-eye view
-    cv::perspectiveTransform(coordinates, dst_points, M);
-    return dst_points;
-}
-
-double calculateAngleOfRoad(std::vector<cv::Point2f> cones_y_b){
-
-                    std::sort(cones_y_b.begin(), cones_y_b.end(),
-                              [](const cv::Point2f &a, const cv::Point2f &b) {
-                                  return a.y > b.y; // Sorting in order from highest to lowest
-                              });
-
-                    double distance = std::sqrt(std::pow(cones_y_b[0].x - X_POSITION_OF_CAR, 2) +
-                                               std::pow(cones_y_b[0].y - Y_POSITION_OF_CAR, 2) * 1.0);
-
-                    double angle;
-                    if (distance < 200)
-                    {
-                        // Getting the angle in radians
-                        double radians =
-                            std::atan2(cones_y_b[0].y - cones_y_b[1].y, cones_y_b[0].x - cones_y_b[1].x);
-
-                        // Converting to degrees
-                        double degrees = radians * 180 / PI;
-
-                        // Adjusting so the value is measured from right x axis
-                        double adjusted = 180 - degrees;
-
-                        if (adjusted > 60 && adjusted < 120)
-                        {
-                            angle = 90;
-                        }
-                        else
-                        {
-                            angle = adjusted;
-                        }
-                    }
-                    else
+#include <thread>
+#include <vector>
+
+// Locks the shared memory and gives the time stamp of the frame in it. Only when that frame was taken
+// out already, processed or skipped, the next notification is awaited, so a frame that arrived while the previous one
+// was processed is picked up at once instead of one frame period later. Returns false with the shared memory
+// unlocked when the wait ended without a new frame, as when the program is told to stop.
+bool lockNewestFrame(cluon::SharedMemory &sharedMemory, const FrameScheduler &scheduler, int64_t &sampleTimeStamp){
+
+                sharedMemory.lock();
+                sampleTimeStamp = cluon::time::toMicroseconds(sharedMemory.getTimeStamp().second);
+                if (!scheduler.isNewFrame(sampleTimeStamp))
+                {
+                    sharedMemory.unlock();
+                    sharedMemory.wait();
+                    sharedMemory.lock();
+                    sampleTimeStamp = cluon::time::toMicroseconds(sharedMemory.getTimeStamp().second);
+                    if (!scheduler.isNewFrame(sampleTimeStamp))
                     {
-                        angle = 90;
+                        sharedMemory.unlock();
+                        return false;
                     }
-
-                    return angle;
-}
-
-double calculateSteeringAngle(std::pair<std::vector<cv::Point2f>, std::vector<cv::Point2f>> cones_y_b){
-                double angleOfRoad = 0.0;
-                double yellowAngle = 0.0;
-                double blueAngle = 0.0;
-
-                // If there are at least 2 blue and 2 yellow cones
-                if ((cones_y_b.first.size() >= 2) && (cones_y_b.second.size() >= 2))
-                {
-
-                
-                    //-------------------yellow  angle
-
-
-                    yellowAngle = calculateAngleOfRoad(cones_y_b.first);
-
-                    //-------------------blue angle
-
-                    
-                    blueAngle = calculateAngleOfRoad(cones_y_b.second);
-
-                    //----------------find mean
-
-                    // Taking the mean value of the found angles
-                    double meanAngle = (yellowAngle + blueAngle) / 2;
-                    angleOfRoad = meanAngle;
-                }
-                else if (cones_y_b.first.size() >= 2)
-                {
-
-                    //------------yellow is angle now
-
-                    yellowAngle = calculateAngleOfRoad(cones_y_b.first);
-
-                    angleOfRoad = yellowAngle;
-                }
-                else if (cones_y_b.second.size() >= 2)
-                {
-
-                    blueAngle = calculateAngleOfRoad(cones_y_b.second);
-
-                    angleOfRoad = blueAngle;
-                }
-                else
-                {
-
-                    angleOfRoad = 90;
-                }
-
-                //--------------------------------------------------this is the end of calculating angles--------------------------------
-
-                // Steering angle starts here --------------------------------------
-
-                double calculated_steeringAngle;
-
-                // after reverse engingeering the groundsteering requests we find out that the ground steering request that are less than 80 degrees means we can send ground steering request
-                if ((angleOfRoad < 90) || (angleOfRoad > 90))
-                {
-
-                    // Getting a value between 0 and 0.6 based on the angle
-                    calculated_steeringAngle = ((angleOfRoad)*0.003333) - 0.3;
-                }
-                else
-                {
-                    calculated_steeringAngle = 0.0;
-                }
-
-                return calculated_steeringAngle;
-}
-
-std::vector<cv::Point2f> drawContours(cv::Mat birdEyeView, cv::Mat reducedImg){
-    // YELLOW
-                std::vector<std::vector<cv::Point>> contours;
-                std::vector<cv::Vec4i> hierarchy;
-                cv::findContours(reducedImg, contours, hierarchy, CV_RETR_TREE,
-                                 CV_CHAIN_APPROX_SIMPLE, cv::Point(0, 0));
-
-                // Get the moments
-                std::vector<cv::Moments> mu(contours.size());
-                for (unsigned int i = 0; i < contours.size(); i++)
-                {
-                    mu[i] = moments(contours[i], false);
                 }
-
-                // Get the mass centers:
-                std::vector<cv::Point2f> mc(contours.size());
-                std::vector<cv::Point2f> mc_transformed(contours.size());
-                for (unsigned int i = 0; i < contours.size(); i++)
-                {
-                    mc[i] = cv::Point2f(float(mu[i].m10 / mu[i].m00),
-                                            float(mu[i].m01 / mu[i].m00));
-                    mc[i].y = mc[i].y + 240;
-
-                    mc_transformed = convertPoints(mc);
-                }
-
-
-                // Draw contours
-                for (unsigned int i = 0; i < contours.size(); i++)
-                {
-                    cv::circle(birdEyeView, mc_transformed[i], 10, cv::Scalar(0, 0, 255), 1,
-                               CV_AA, 0);
-                }
-
-                return mc_transformed;
-}
-
-
-std::pair<cv::Mat, cv::Mat> reduceImage(std::pair<cv::Mat, cv::Mat> masked_y_b){
-
-    std::pair<cv::Mat, cv::Mat> reducedImg;
-
-                cv::dilate(masked_y_b.first, reducedImg.first, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3)));
-                cv::erode(reducedImg.first, reducedImg.first, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(6, 6)));
-
-                cv::dilate(masked_y_b.second, reducedImg.second, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(7, 7)));
-
-
-                //cv::Mat combined_masks;
-                //cv::Mat resultAfterBlur;
-
-                //cv::bitwise_or(reducedImg.second, reducedImg.first, combined_masks);
-
-                cv::GaussianBlur(reducedImg.first, reducedImg.first, cv::Size(15, 15), 0);
-                cv::GaussianBlur(reducedImg.second, reducedImg.second, cv::Size(15, 15), 0);
-
-                return reducedImg;
-
-}
-
-
-std::pair<cv::Mat, cv::Mat> maskCones(cv::Mat cropped){
-    
-
-                int minH_y = 6;
-            int maxH_y = 30;
-
-            int minS_y = 51;
-            int maxS_y = 235;
-
-            int minV_y = 75;
-            int maxV_y = 255;
-
-            int minH_b = 106;
-            int maxH_b = 155;
-
-            int minS_b = 59;
-            int maxS_b = 255;
-
-            int minV_b = 29;
-            int maxV_b = 255;
-
-            int minH_b_reflection = 121;
-            int maxH_b_reflection = 179;
-
-            int minS_b_reflection = 0;
-            int maxS_b_reflection = 98;
-
-            int minV_b_reflection = 0;
-            int maxV_b_reflection = 255;
-
-            
-
-            cv::Mat masked_y;
-            cv::Mat masked_b;
-            cv::Mat colouredImg;
-            cv::Mat blueImg;
-            cv::Mat blueReflectionImg;
-            cv::Mat masked_reflection;
-            cv::Mat masked_blueAndReflection;
-            cv::Mat masked_blueWithoutReflection;
-
-            cv::cvtColor(cropped, colouredImg, CV_BGR2HSV);
-
-                // Colour process to detect yellow cones
-                cv::inRange(colouredImg, cv::Scalar(minH_y, minS_y, minV_y),
-                            cv::Scalar(maxH_y, maxS_y, maxV_y),
-                            masked_y);
-
-                // Colour process to detect blue cones
-                cv::inRange(colouredImg, cv::Scalar(minH_b, minS_b, minV_b),
-                            cv::Scalar(maxH_b, maxS_b, maxV_b), masked_b);
-
-                // Colour process to detect large reflections
-                cv::inRange(
-                    colouredImg,
-                    cv::Scalar(minH_b_reflection, minS_b_reflection, minV_b_reflection),
-                    cv::Scalar(maxH_b_reflection, maxS_b_reflection,
-                               maxV_b_reflection),
-                    masked_reflection);
-
-                
-
-                // Use bitwise AND operator to find reflections in blue cone image
-                cv::bitwise_and(masked_b, masked_reflection, masked_blueAndReflection);
-
-
-                // Use bitwise XOR operator to remove found reflections from blue cone image
-                cv::bitwise_xor(masked_blueAndReflection, masked_b, masked_blueWithoutReflection);
-
-                std::pair<cv::Mat, cv::Mat> masked_y_b = std::make_pair(masked_y, masked_blueWithoutReflection);
-
-                return masked_y_b;
+                return true;
 
 }
 
@@ -327,14 +87,41 @@ int32_t main(int32_t argc, char **argv)
     if ((0 == commandlineArguments.count("cid")) ||
         (0 == commandlineArguments.count("name")) ||
         (0 == commandlineArguments.count("width")) ||
-        (0 == commandlineArguments.count("height")))
+        (0 == commandlineArguments.count("height")) ||
+        ((0 != commandlineArguments.count("lut")) && !ConeColourLut::isValidBits(std::stoi(commandlineArguments["lut"]))) ||
+        ((0 != commandlineArguments.count("near-scale")) && !FrameWorkspace::isValidReduction(static_cast<uint32_t>(std::stoi(commandlineArguments["near-scale"])))))
     {
         std::cerr << argv[0] << " attaches to a shared memory area containing an ARGB image." << std::endl;
-        std::cerr << "Usage:   " << argv[0] << " --cid=<OD4 session> --name=<name of shared memory area> [--verbose]" << std::endl;
+        std::cerr << "Usage:   " << argv[0] << " --cid=<OD4 session> --name=<name of shared memory area> [--roi-top=<row>] [--roi-height=<rows>] [--lut=<5|6|8>] [--min-cone-area=<pixels>] [--max-cone-area=<pixels>] [--parallel-channels] [--track-rescan=<frames>] [--near-band=<rows>] [--near-scale=<2|4>] [--byte-masks] [--calibration=<file>] [--pipelined] [--pipeline-slots=<n>] [--deadline=<ms>] [--fps=<frames/s>] [--stats-interval=<frames>] [--capture=<file>] [--output=<file>|shm:<name>] [--output-interval=<ms>] [--output-latency=<ms>] [--publish] [--sender-stamp=<n>] [--rcvbuf=<bytes>] [--od4-queue=<envelopes>] [--od4-overflow=<block|drop-oldest|drop-newest>] [--verbose]" << std::endl;
         std::cerr << "         --cid:    CID of the OD4Session to send and receive messages" << std::endl;
         std::cerr << "         --name:   name of the shared memory area to attach" << std::endl;
         std::cerr << "         --width:  width of the frame" << std::endl;
         std::cerr << "         --height: height of the frame" << std::endl;
+        std::cerr << "         --roi-top:    first row of the region that is searched for cones (default: height / 2)" << std::endl;
+        std::cerr << "         --roi-height: number of rows of the region that is searched for cones (default: 120)" << std::endl;
+        std::cerr << "         --lut:    classify cone colours with a lookup table of 5, 6 or 8 bits per channel instead of the HSV conversion" << std::endl;
+        std::cerr << "         --min-cone-area: smallest blob in pixels that is considered a cone (default: 1)" << std::endl;
+        std::cerr << "         --max-cone-area: largest blob in pixels that is considered a cone (default: unlimited)" << std::endl;
+        std::cerr << "         --parallel-channels: process the yellow and the blue cones concurrently after masking (serial on single-core targets)" << std::endl;
+        std::cerr << "         --near-band:      number of rows at the bottom of the region that are searched at reduced resolution, where cones are large (default: 0)" << std::endl;
+        std::cerr << "         --near-scale:     reduction of the near band in both directions, 2 or 4 (default: 2)" << std::endl;
+        std::cerr << "         --calibration:    bird's-eye calibration: the 3x3 matrix row by row, or four lines 'srcX srcY dstX dstY' (default: built in)" << std::endl;
+        std::cerr << "         --byte-masks:     filter byte masks with cv::dilate, cv::erode and cv::GaussianBlur like the original instead of keeping them at one bit per pixel, where the blur is a dilation and blob edges can differ slightly; these filters allocate on every call" << std::endl;
+        std::cerr << "         --track-rescan:   track the cones and search only around them, with a search of the whole region every this many frames (default: 0, no tracking)" << std::endl;
+        std::cerr << "         --pipelined:      run the stages of the cone pipeline on threads of their own, pinned to one core each while there are cores, and those from the homography on together on one; frames are dropped while all slots are busy" << std::endl;
+        std::cerr << "         --pipeline-slots: number of frames in flight in the pipelined mode (default: 8)" << std::endl;
+        std::cerr << "         --deadline:       milliseconds from taking a frame to its result; later results are not sent (default: 0, no deadline)" << std::endl;
+        std::cerr << "         --fps:            nominal frame rate of the camera, from which frames overwritten in the shared memory are counted (default: estimated from the shortest gaps between frames)" << std::endl;
+        std::cerr << "         --stats-interval: frames between reports of the stage latencies and frame counters (default: 300 with --verbose, otherwise only at exit)" << std::endl;
+        std::cerr << "         --capture:        append every frame with its sample time stamp to a raw frame file for bench-pipeline --raw" << std::endl;
+        std::cerr << "         --output:         where the steering angles are written: a file that is appended to, or a ring in the named shared memory (default: stdout)" << std::endl;
+        std::cerr << "         --output-interval: milliseconds between two passes of the writer over the new results (default: 5)" << std::endl;
+        std::cerr << "         --output-latency:  milliseconds a result may stay buffered before it is written; 0 writes every pass (default: 20)" << std::endl;
+        std::cerr << "         --publish:        also send every steering angle as GroundSteeringRequest with the sample time stamp of its frame to the OD4Session" << std::endl;
+        std::cerr << "         --sender-stamp:   senderStamp of the published requests; requests with it are not used as ground steering (default: 10)" << std::endl;
+        std::cerr << "         --rcvbuf:         receive buffer of the OD4Session's socket in bytes that absorbs bursts of messages; 0 keeps the system default (default: 26214400)" << std::endl;
+        std::cerr << "         --od4-queue:      number of received envelopes queued for decoding (default: 1024)" << std::endl;
+        std::cerr << "         --od4-overflow:   what happens to an envelope while the queue is full: block keeps it in the receive buffer, drop-oldest and drop-newest discard one (default: block)" << std::endl;
         std::cerr << "Example: " << argv[0] << " --cid=253 --name=img --width=640 --height=480 --verbose" << std::endl;
     }
     else
@@ -344,6 +131,34 @@ int32_t main(int32_t argc, char **argv)
         const uint32_t WIDTH{static_cast<uint32_t>(std::stoi(commandlineArguments["width"]))};
         const uint32_t HEIGHT{static_cast<uint32_t>(std::stoi(commandlineArguments["height"]))};
         const bool VERBOSE{commandlineArguments.count("verbose") != 0};
+        const uint32_t MIN_CONE_AREA{(commandlineArguments.count("min-cone-area") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["min-cone-area"])) : 1};
+        const uint32_t MAX_CONE_AREA{(commandlineArguments.count("max-cone-area") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["max-cone-area"])) : std::numeric_limits<uint32_t>::max()};
+        const uint32_t ROI_TOP{(commandlineArguments.count("roi-top") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["roi-top"])) : HEIGHT / 2};
+        const uint32_t ROI_HEIGHT{(commandlineArguments.count("roi-height") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["roi-height"])) : 120};
+        const std::string CAPTURE{(commandlineArguments.count("capture") != 0) ? commandlineArguments["capture"] : ""};
+        const std::string OUTPUT{(commandlineArguments.count("output") != 0) ? commandlineArguments["output"] : ""};
+        const int64_t OUTPUT_INTERVAL_MS{(commandlineArguments.count("output-interval") != 0) ? std::max<int64_t>(1, std::stoi(commandlineArguments["output-interval"])) : 5};
+        const int64_t OUTPUT_LATENCY_MS{(commandlineArguments.count("output-latency") != 0) ? std::max<int64_t>(0, std::stoi(commandlineArguments["output-latency"])) : 20};
+        const bool PUBLISH{commandlineArguments.count("publish") != 0};
+        const uint32_t SENDER_STAMP{(commandlineArguments.count("sender-stamp") != 0) ? static_cast<uint32_t>(std::stoul(commandlineArguments["sender-stamp"])) : 10};
+        const int32_t RCVBUF{(commandlineArguments.count("rcvbuf") != 0) ? std::max(0, std::stoi(commandlineArguments["rcvbuf"])) : cluon::UDPReceiver::DEFAULT_RECEIVE_BUFFER_SIZE};
+        const std::size_t OD4_QUEUE{(commandlineArguments.count("od4-queue") != 0) ? static_cast<std::size_t>(std::max(1, std::stoi(commandlineArguments["od4-queue"]))) : cluon::NotifyingPipelineBase::DEFAULT_CAPACITY};
+        const std::string OD4_OVERFLOW{(commandlineArguments.count("od4-overflow") != 0) ? commandlineArguments["od4-overflow"] : "block"};
+        const cluon::NotifyingPipelineBase::OverflowPolicy OD4_OVERFLOW_POLICY{("drop-oldest" == OD4_OVERFLOW) ? cluon::NotifyingPipelineBase::OverflowPolicy::DROP_OLDEST
+                                                                             : ("drop-newest" == OD4_OVERFLOW) ? cluon::NotifyingPipelineBase::OverflowPolicy::DROP_NEWEST
+                                                                                                               : cluon::NotifyingPipelineBase::OverflowPolicy::BLOCK};
+        const bool PARALLEL_CHANNELS{commandlineArguments.count("parallel-channels") != 0};
+        const uint32_t TRACK_RESCAN{(commandlineArguments.count("track-rescan") != 0) ? static_cast<uint32_t>(std::max(0, std::stoi(commandlineArguments["track-rescan"]))) : 0};
+        const uint32_t NEAR_BAND{(commandlineArguments.count("near-band") != 0) ? static_cast<uint32_t>(std::max(0, std::stoi(commandlineArguments["near-band"]))) : 0};
+        const uint32_t NEAR_SCALE{(commandlineArguments.count("near-scale") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["near-scale"])) : 2};
+        const bool PACKED_MASKS{commandlineArguments.count("byte-masks") == 0};
+        const std::string CALIBRATION{(commandlineArguments.count("calibration") != 0) ? commandlineArguments["calibration"] : ""};
+        const bool PIPELINED{commandlineArguments.count("pipelined") != 0};
+        const uint32_t PIPELINE_SLOTS{(commandlineArguments.count("pipeline-slots") != 0) ? static_cast<uint32_t>(std::max(1, std::stoi(commandlineArguments["pipeline-slots"]))) : 8};
+        const int64_t DEADLINE_MS{(commandlineArguments.count("deadline") != 0) ? std::max<int64_t>(0, std::stoi(commandlineArguments["deadline"])) : 0};
+        const double FPS{(commandlineArguments.count("fps") != 0) ? std::stod(commandlineArguments["fps"]) : 0.0};
+        const uint64_t STATS_INTERVAL{(commandlineArguments.count("stats-interval") != 0) ? static_cast<uint64_t>(std::max(0, std::stoi(commandlineArguments["stats-interval"]))) : (VERBOSE ? 300u : 0u)};
+        const uint32_t LUT_BITS{(commandlineArguments.count("lut") != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["lut"])) : 0};
 
         // Attach to the shared memory.
         std::unique_ptr<cluon::SharedMemory> sharedMemory{new cluon::SharedMemory{NAME}};
@@ -351,187 +166,355 @@ int32_t main(int32_t argc, char **argv)
         {
             std::clog << argv[0] << ": Attached to shared memory '" << sharedMemory->name() << " (" << sharedMemory->size() << " bytes)." << std::endl;
 
+            // The received ground steering requests by their sample time stamps; frames look up the
+            // steering at their own time stamp without taking a lock. Declared before the OD4Session
+            // so that it outlives the thread that appends to it.
+            SteeringHistory groundSteering{1024};
+
             // Interface to a running OpenDaVINCI session where network messages are exchanged.
             // The instance od4 allows you to send and receive messages.
-            cluon::OD4Session od4{static_cast<uint16_t>(std::stoi(commandlineArguments["cid"]))};
+            cluon::OD4Session od4{static_cast<uint16_t>(std::stoi(commandlineArguments["cid"])), nullptr, RCVBUF, OD4_QUEUE, OD4_OVERFLOW_POLICY};
 
-            opendlv::proxy::GroundSteeringRequest gsr;
-            std::mutex gsrMutex;
-            auto onGroundSteeringRequest = [&gsr, &gsrMutex](cluon::data::Envelope &&env) {
+            auto onGroundSteeringRequest = [&groundSteering, PUBLISH, SENDER_STAMP](cluon::data::Envelope &&env) {
+                // Our own published requests come back through the multicast group
+                if (PUBLISH && (SENDER_STAMP == env.senderStamp()))
+                {
+                    return;
+                }
                 // The envelope data structure provide further details, such as sampleTimePoint as shown in this test case:
                 // https://github.com/chrberger/libcluon/blob/master/libcluon/testsuites/TestEnvelopeConverter.cpp#L31-L40
-                std::lock_guard<std::mutex> lck(gsrMutex);
-                gsr = cluon::extractMessage<opendlv::proxy::GroundSteeringRequest>(std::move(env));
+                const int64_t sampleTimeStamp{cluon::time::toMicroseconds(env.sampleTimeStamp())};
+                const opendlv::proxy::GroundSteeringRequest gsr = cluon::extractMessage<opendlv::proxy::GroundSteeringRequest>(std::move(env));
+                groundSteering.push(sampleTimeStamp, static_cast<double>(gsr.groundSteering()));
                 //std::cout << "lambda: groundSteering = " << gsr.groundSteering() << std::endl;
             };
 
             od4.dataTrigger(opendlv::proxy::GroundSteeringRequest::ID(), onGroundSteeringRequest);
 
-            IplImage *iplimage{nullptr};
-            CvSize size;
-            size.width = WIDTH;
-            size.height = HEIGHT;
+            // Everything else on the CID is dropped after its dataType was read, without decoding it
+            auto reportEnvelopes = [&od4](std::ostream &out) {
+                const cluon::NotifyingPipelineBase::Statistics queue{od4.pipelineStatistics()};
+                out << "od4: " << queue.added << " envelopes queued, " << queue.processed << " processed, " << queue.dropped << " dropped, " << queue.blocked
+                    << " waited for a full queue" << std::endl;
+                for (const auto &entry : od4.envelopeCounters())
+                {
+                    out << "od4: dataType " << entry.first << ": " << entry.second.decoded << " decoded, " << entry.second.skipped << " skipped" << std::endl;
+                }
+            };
 
-            iplimage = cvCreateImageHeader(size, IPL_DEPTH_8U, 4 /* four channels: ARGB */);
-            sharedMemory->lock();
+            // Tables for the colour classification are set up once before the first frame
+            const ConeColourClassifier exactClassifier;
+            std::unique_ptr<ConeColourLut> lut;
+            if (0 != LUT_BITS)
             {
-                iplimage->imageData = sharedMemory->data();
-                iplimage->imageDataOrigin = iplimage->imageData;
+                lut.reset(new ConeColourLut{exactClassifier, LUT_BITS});
+                std::clog << argv[0] << ": Using " << LUT_BITS << "-bit colour lookup table (" << lut->tableSize() << " bytes), "
+                          << lut->agreement() * 100 << "% agreement with the HSV conversion." << std::endl;
             }
-            sharedMemory->unlock();
-
-            double actual_steeringAngle;
-
-            double turning_correct = 0.0;
-            double turning_incorrect = 0.0;
-            double turning_total = 0.0;
-            double straight_total = 0.0;
-            double straight_correct = 0.0;
-            double straight_incorrect = 0.0;
-            double straight_correct_p = 0.0;
-            double turning_correct_p = 0.0;
-            double straight_p = 0.0;
-            double turning_p = 0.0;
-            double total_p = 0.0;
-            double allFrames = 0.0;
-
-            // Endless loop; end the program by pressing Ctrl-C.
-            while (od4.isRunning())
+            const ConeClassifier &classifier = lut ? static_cast<const ConeClassifier &>(*lut) : exactClassifier;
+
+            // The bird's-eye transform is fixed for the whole run; a calibration file is solved once here
+            Homography perspective{getMatrix()};
+            if (!CALIBRATION.empty() && !Homography::load(CALIBRATION, perspective))
             {
+                std::cerr << argv[0] << ": Failed to read the calibration '" << CALIBRATION << "'." << std::endl;
+                return retCode;
+            }
 
-                cluon::data::TimeStamp before{cluon::time::now()};
+            SteeringAccuracy accuracy;
 
-                // Access the latest received pedal position and lock the mutex
+            // Always the newest frame is processed; frames that were overwritten before are counted as dropped
+            FrameScheduler scheduler{DEADLINE_MS * 1000, (0.0 < FPS) ? static_cast<int64_t>(std::llround(1000000.0 / FPS)) : 0};
+
+            // Every frame taken out of the shared memory is appended to the capture file
+            std::unique_ptr<RawFrameWriter> capture;
+            if (!CAPTURE.empty())
+            {
+                capture.reset(new RawFrameWriter{CAPTURE, WIDTH, HEIGHT});
+                if (!capture->valid())
                 {
-                    std::lock_guard<std::mutex> lck(gsrMutex);
-                    actual_steeringAngle = gsr.groundSteering();
-                    //std::cout << "main: groundSteering = " << gsr.groundSteering() << std::endl;
+                    capture.reset();
                 }
+                else
+                {
+                    std::clog << argv[0] << ": Capturing frames to '" << CAPTURE << "' after " << capture->frames() << " frames already in it." << std::endl;
+                }
+            }
 
-                // OpenCV data structure to hold an image.
-                cv::Mat img;
-                cv::Mat cropped;
-                // Wait for a notification of a new frame.
-                sharedMemory->wait();
+            // The steering angles are formatted and written in batches by a thread of their own, so the
+            // frame loop never waits for a pipe or a container log
+            std::unique_ptr<ResultSink> sink;
+            if (OUTPUT.empty())
+            {
+                sink.reset(new FileResultSink);
+            }
+            else if (0 == OUTPUT.find("shm:"))
+            {
+                sink.reset(new SharedMemoryResultSink{OUTPUT.substr(4), 64 * 1024});
+            }
+            else
+            {
+                sink.reset(new FileResultSink{OUTPUT});
+            }
+            if (!sink->valid())
+            {
+                return retCode;
+            }
+            ResultWriter results{std::move(sink), std::chrono::milliseconds(OUTPUT_INTERVAL_MS), std::chrono::milliseconds(OUTPUT_LATENCY_MS)};
 
-                // Lock the shared memory.
-                sharedMemory->lock();
+            // The steering angles go to the controllers over the OD4Session, encoded into a buffer that is reused
+            std::unique_ptr<SteeringPublisher> publisher;
+            if (PUBLISH)
+            {
+                publisher.reset(new SteeringPublisher{static_cast<uint16_t>(std::stoi(commandlineArguments["cid"])), opendlv::proxy::GroundSteeringRequest::ID(), SENDER_STAMP});
+                if (!publisher->valid())
+                {
+                    return retCode;
+                }
+            }
+
+            // Latency of every stage, taken with the monotonic clock
+            StageLatencies latencies;
+            LatencyHistogram &ingestLatency = latencies.add("ingest");
 
-                std::string stringTimeSample;
-                stringTimeSample.append(std::to_string(cluon::time::toMicroseconds(sharedMemory->getTimeStamp().second)));
+            // The yellow and the blue chain are independent after masking; with --parallel-channels they run
+            // side by side and join before the steering angle is calculated. Single-core targets stay serial.
+            WorkerPool channelPool{(PARALLEL_CHANNELS && (1 < std::thread::hardware_concurrency())) ? 1u : 0u};
 
-                // CROP THE IMAGE ---------------------------
+            // Cones are followed from frame to frame, so most frames are only searched around them
+            std::unique_ptr<ConeTracker> tracker;
+            if (0 < TRACK_RESCAN)
+            {
+                tracker.reset(new ConeTracker{perspective, FrameWorkspace::cropOf(WIDTH, HEIGHT, ROI_TOP, ROI_HEIGHT), TRACK_RESCAN});
+            }
 
+            // The stages of the cone pipeline; run one after another on this thread or,
+            // with --pipelined, each on its own thread
+            std::vector<ConeStage> stages;
+            const std::size_t lightStages{addConeStages(stages, latencies, classifier, PARALLEL_CHANNELS ? &channelPool : nullptr, tracker.get())};
+            if (PARALLEL_CHANNELS)
+            {
+                std::clog << argv[0] << ": Processing the cone colours on " << channelPool.concurrency() << " thread(s)." << std::endl;
+            }
+            stages.push_back(timedStage(latencies, "output", [&accuracy, &scheduler, &groundSteering, &results, &publisher](FrameWorkspace &slot) {
+                // Results that are too stale for the controller are not sent
+                if (!scheduler.withinDeadline(slot.startedMicroseconds, cluon::time::toMicroseconds(cluon::time::now())))
                 {
-                    //--------------------------------------------------------------------------------------------------------------------
-                    // Copy the pixels from the shared memory into our own data structure.
-                    cv::Mat wrapped(HEIGHT, WIDTH, CV_8UC4, sharedMemory->data());
-                    img = wrapped.clone();
+                    scheduler.miss();
+                    return;
+                }
 
-                    img = cv::cvarrToMat(iplimage);
+                // Compare with the steering at the time the frame was taken; looked up as late as possible
+                // so that the request following the frame has had time to arrive
+                slot.actual_steeringAngle = groundSteering.at(slot.sampleTimeStamp);
+                accuracy.add(slot.actual_steeringAngle, slot.calculated_steeringAngle);
 
-                    cropped = img(cv::Rect(0, img.rows / 2, img.cols, 120));
+                if (publisher)
+                {
+                    publisher->publish(static_cast<float>(slot.calculated_steeringAngle), cluon::time::toMicroseconds(cluon::time::now()), slot.sampleTimeStamp);
                 }
-                sharedMemory->unlock();
-
-                std::pair<cv::Mat, cv::Mat> masked_y_b = maskCones(cropped);
-    
+                results.push(slot.sampleTimeStamp, slot.calculated_steeringAngle);
+            }));
+
+            // Count the heap allocations of this thread, including every cv::Mat buffer
+            CountingMatAllocator matAllocator;
+            cv::Mat::setDefaultAllocator(&matAllocator);
+            SteadyStateAllocations steadyState;
+            uint64_t frameCount{0};
+
+            // SIGINT or SIGTERM ends the loop below, but it may be waiting for a frame that never comes, as when
+            // the camera was stopped first; it is woken until it has ended, so the reports are still printed
+            std::atomic<bool> loopEnded{false};
+            std::thread loopWaker{[&od4, &sharedMemory, &loopEnded]() {
+                while (!loopEnded.load())
+                {
+                    if (!od4.isRunning())
+                    {
+                        sharedMemory->notifyAll();
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }};
 
-                // DETECT CONES ---------------------------
+            if (PIPELINED)
+            {
+                // Every slot owns a complete set of buffers, allocated once here
+                std::vector<std::unique_ptr<FrameWorkspace>> slots;
+                for (uint32_t i = 0; i < PIPELINE_SLOTS; i++)
+                {
+                    slots.emplace_back(new FrameWorkspace{WIDTH, HEIGHT, ROI_TOP, ROI_HEIGHT, perspective, MIN_CONE_AREA, MAX_CONE_AREA});
+                    slots.back()->useNearBand(NEAR_BAND, NEAR_SCALE);
+                    if (PACKED_MASKS)
+                    {
+                        slots.back()->usePackedMasks();
+                    }
+                }
+                // The stages from the homography to the output take microseconds and share one thread
+                FramePipeline<FrameWorkspace>::mergeStages(stages, lightStages, "geometry");
+                FramePipeline<FrameWorkspace> pipeline{std::move(slots), std::move(stages), true};
+                std::clog << argv[0] << ": Pipelined processing with " << PIPELINE_SLOTS << " frame slots." << std::endl;
 
-                std::pair<cv::Mat, cv::Mat> reducedImg = reduceImage(masked_y_b);
+                // A dropped frame that is captured is copied here under the lock and written after it
+                std::vector<uint8_t> droppedFrame(capture ? capture->frameSize() : 0);
+                int64_t lastCaptured{std::numeric_limits<int64_t>::min()};
 
-                cv::Mat dst(480, 640, CV_8UC3);
+                // This thread only ingests frames; a frame is dropped when no slot is free
+                while (od4.isRunning())
+                {
+                    int64_t sampleTimeStamp{0};
+                    if (!lockNewestFrame(*sharedMemory, scheduler, sampleTimeStamp))
+                    {
+                        continue;
+                    }
+                    const bool captureFrame{capture && (sampleTimeStamp != lastCaptured)};
+                    FrameWorkspace *slot = pipeline.acquire();
+                    if (nullptr != slot)
+                    {
+                        scheduler.accept(sampleTimeStamp);
+                        slot->startedMicroseconds = cluon::time::toMicroseconds(cluon::time::now());
+                        slot->sampleTimeStamp = sampleTimeStamp;
+                        const LatencyHistogram::Clock::time_point ingestStart{LatencyHistogram::Clock::now()};
+                        ingestFrame(sharedMemory->data(), *slot, captureFrame);
+                        ingestLatency.recordSince(ingestStart);
+                    }
+                    else
+                    {
+                        // Marked as seen, so the next frame is awaited instead of taking this one again
+                        scheduler.skip(sampleTimeStamp);
+                        if (captureFrame)
+                        {
+                            // The frame is not processed but still captured
+                            std::memcpy(droppedFrame.data(), sharedMemory->data(), droppedFrame.size());
+                        }
+                    }
+                    sharedMemory->unlock();
 
-                cv::Mat original = img.clone();
+                    // Every frame is written once, outside the lock, so the camera is never kept waiting for the disk
+                    if (captureFrame)
+                    {
+                        capture->append(sampleTimeStamp, (nullptr != slot) ? slot->frame.data : droppedFrame.data());
+                        lastCaptured = sampleTimeStamp;
+                    }
+                    if (nullptr != slot)
+                    {
+                        pipeline.submit(slot);
+                    }
 
-                // Calculates a matrix of a perspective transform
+                    if ((0 < STATS_INTERVAL) && (0 == (++frameCount % STATS_INTERVAL)))
+                    {
+                        pipeline.report(std::clog);
+                        results.report(std::clog);
+                        scheduler.report(std::clog);
+                        latencies.report(std::clog);
+                        reportEnvelopes(std::clog);
+                    }
+                }
 
-                cv::warpPerspective(original, dst, getMatrix(), dst.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+                pipeline.stop();
+                pipeline.report(std::clog);
+            }
+            else
+            {
+                // All buffers of the pipeline are allocated once here and reused for every frame
+                FrameWorkspace ws{WIDTH, HEIGHT, ROI_TOP, ROI_HEIGHT, perspective, MIN_CONE_AREA, MAX_CONE_AREA};
+                ws.useNearBand(NEAR_BAND, NEAR_SCALE);
+                if (PACKED_MASKS)
+                {
+                    ws.usePackedMasks();
+                }
 
-                cv::Mat birdEyeView = dst;
+                // The warped full frame is only produced when it is displayed
+                BirdEyeRenderer birdEyeRenderer{ws.perspective.toMat()};
 
-                std::vector<cv::Point2f> mc_transformed_yel = drawContours(birdEyeView, reducedImg.first);
-                std::vector<cv::Point2f> mc_transformed_blue = drawContours(birdEyeView, reducedImg.second);
+                // A frame is captured once, even when it is taken out again after a notification without a new one
+                int64_t lastCaptured{std::numeric_limits<int64_t>::min()};
 
+                // Endless loop; end the program by pressing Ctrl-C.
+                while (od4.isRunning())
+                {
 
-                std::pair<std::vector<cv::Point2f>, std::vector<cv::Point2f>> contours_y_b =
-                    std::make_pair(mc_transformed_yel, mc_transformed_blue);
+                    steadyState.begin();
 
-                std::pair<std::vector<cv::Point2f>, std::vector<cv::Point2f>>
-                    cones_y_b = contours_y_b;
+                    // Lock the shared memory, waiting for a notification only when there is no newer frame.
+                    if (!lockNewestFrame(*sharedMemory, scheduler, ws.sampleTimeStamp))
+                    {
+                        continue;
+                    }
+                    scheduler.accept(ws.sampleTimeStamp);
+                    ws.startedMicroseconds = cluon::time::toMicroseconds(cluon::time::now());
 
-                //--------------------------------------------------this is the start of calculating angles --------------------------------
+                    // CROP THE IMAGE ---------------------------
 
-                double calculated_steeringAngle = calculateSteeringAngle(cones_y_b);
+                    // Copy only the pixels that are processed while holding the lock.
+                    const LatencyHistogram::Clock::time_point ingestStart{LatencyHistogram::Clock::now()};
+                    const bool captureFrame{capture && (ws.sampleTimeStamp != lastCaptured)};
+                    ingestFrame(sharedMemory->data(), ws, VERBOSE || captureFrame);
+                    ingestLatency.recordSince(ingestStart);
+                    sharedMemory->unlock();
 
-                if (actual_steeringAngle >= 0 && actual_steeringAngle <= 0)
-                {
-                    straight_total += 1.0;
-                    if ((calculated_steeringAngle > (actual_steeringAngle * 1.05)) || (calculated_steeringAngle < (actual_steeringAngle * 0.95)))
+                    if (captureFrame)
                     {
-                        straight_incorrect += 1.0;
+                        capture->append(ws.sampleTimeStamp, ws.frame.data);
+                        lastCaptured = ws.sampleTimeStamp;
                     }
-                    else
+
+                    // DETECT CONES AND CALCULATE THE STEERING ANGLE ---------------------------
+
+                    // A frame that ran out of time is abandoned; the next one is newer anyway.
+                    for (const ConeStage &stage : stages)
                     {
-                        straight_correct += 1.0;
+                        if (!scheduler.withinDeadline(ws.startedMicroseconds, cluon::time::toMicroseconds(cluon::time::now())))
+                        {
+                            scheduler.miss();
+                            break;
+                        }
+                        stage.process(ws);
                     }
-                }
-                else
-                {
-                    turning_total += 1.0;
-                    if ((calculated_steeringAngle > (actual_steeringAngle * 1.5)) || (calculated_steeringAngle < (actual_steeringAngle * 0.5)))
+
+                    // Every frame after the first one must be processed without touching the heap; only
+                    // the OpenCV filters of --byte-masks allocate
+                    steadyState.end(std::clog);
+                    if ((0 < STATS_INTERVAL) && (0 == (++frameCount % STATS_INTERVAL)))
                     {
-                        turning_incorrect += 1.0;
+                        steadyState.report(std::clog);
+                        results.report(std::clog);
+                        scheduler.report(std::clog);
+                        latencies.report(std::clog);
+                        reportEnvelopes(std::clog);
                     }
-                    else
+
+                    // Display image on your screen.
+                    if (VERBOSE)
                     {
-                        turning_correct += 1.0;
+                        cv::imshow(sharedMemory->name().c_str(), ws.frame);
+                        cv::imshow(sharedMemory->name() + " (bird's-eye view)", birdEyeRenderer.render(ws.frame, ws.yellow.cones, ws.blue.cones));
+                        cv::waitKey(1);
                     }
                 }
+            }
 
-                straight_correct_p = (straight_correct / (straight_correct + straight_incorrect)) * 100;
-                turning_correct_p = (turning_correct / (turning_correct + turning_incorrect)) * 100;
-                straight_p = (straight_total / (turning_total + straight_total)) * 100;
-                turning_p = (turning_total / (turning_total + straight_total)) * 100;
-                total_p = ((straight_correct_p * straight_p) + (turning_correct_p * turning_p)) / 100;
-                
-                //std::cout << "Correct 0 is " << straight_correct_p << std::endl;
-                //std::cout << "Correct turn is " << turning_correct_p << std::endl;
-                //std::cout << "straight total is " << straight_p << std::endl;
-                //std::cout << "turning total is " << turning_p << std::endl;
-                //std::cout << "Correct total is " << total_p << std::endl;
-                //std::cout << "nr of frames " << turning_total + straight_total << std::endl;
-                
-                cluon::data::TimeStamp after{cluon::time::now()};
-
-                double time_diff = cluon::time::toMicroseconds(after) - cluon::time::toMicroseconds(before);
-
-                allFrames += time_diff;
-
-                //std::cout << "time diff= " << time_diff << std::endl;
-                //std::cout << "time diff ave= " << allFrames / (turning_total + straight_total) << std::endl;
-
-                std::cout << "group_10;" << stringTimeSample << ";" << calculated_steeringAngle << std::endl;
-
-                // If you want to access the latest received ground steering, don't forget to lock the mutex:
-                {
-                    std::lock_guard<std::mutex> lck(gsrMutex);
-                    //std::cout << "main: groundSteering = " << gsr.groundSteering() << std::endl;
-                }
+            loopEnded.store(true);
+            loopWaker.join();
 
-                // Display image on your screen.
-                if (VERBOSE)
-                {
-                    cv::imshow(sharedMemory->name().c_str(), img);
-                    cv::waitKey(1);
-                }
+            // The loop ends after SIGINT or SIGTERM; report what was seen until then
+            results.stop();
+            results.report(std::clog);
+            if (publisher)
+            {
+                publisher->report(std::clog);
             }
-
-            if (nullptr != iplimage)
+            if (tracker)
+            {
+                tracker->report(std::clog);
+            }
+            scheduler.report(std::clog);
+            latencies.report(std::clog);
+            reportEnvelopes(std::clog);
+            if (!PIPELINED)
             {
-                cvReleaseImageHeader(&iplimage);
+                steadyState.report(std::clog);
             }
+            cv::Mat::setDefaultAllocator(nullptr);
         }
         retCode = 0;
     }
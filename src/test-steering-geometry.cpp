@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the steering geometry against the original implementation, which sorted the cones and used
+// std::pow and std::sqrt: the angles have to be identical to the bit, so the steering buckets of the
+// recordings do not change, and computing them must not touch the heap.
+
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#include "allocation-counter.hpp"
+#include "steering-geometry.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace reference
+{
+// The sort of the original code; std::sort, or std::stable_sort for more than 16 cones at the same
+// height, whose order std::sort leaves unspecified.
+using Sort = std::function<void(std::vector<cv::Point2f> &)>;
+
+inline void sortByHeight(std::vector<cv::Point2f> &cones)
+{
+    std::sort(cones.begin(), cones.end(), [](const cv::Point2f &a, const cv::Point2f &b) { return a.y > b.y; });
+}
+
+inline void stableSortByHeight(std::vector<cv::Point2f> &cones)
+{
+    std::stable_sort(cones.begin(), cones.end(), [](const cv::Point2f &a, const cv::Point2f &b) { return a.y > b.y; });
+}
+
+// calculateAngleOfRoad() as it was before the cones were left unsorted.
+inline double angleOfRoad(std::vector<cv::Point2f> cones, const Sort &sort)
+{
+    sort(cones);
+    double distance = std::sqrt(std::pow(cones[0].x - X_POSITION_OF_CAR, 2) + std::pow(cones[0].y - Y_POSITION_OF_CAR, 2) * 1.0);
+    if (distance < 200)
+    {
+        double radians = std::atan2(cones[0].y - cones[1].y, cones[0].x - cones[1].x);
+        double degrees = radians * 180 / PI;
+        double adjusted = 180 - degrees;
+        return (adjusted > 60 && adjusted < 120) ? 90 : adjusted;
+    }
+    return 90;
+}
+
+// calculateSteeringAngle() as it was before.
+inline double steeringAngle(const std::vector<cv::Point2f> &yellow, const std::vector<cv::Point2f> &blue, const Sort &sort)
+{
+    double angleOfRoad = 90;
+    if ((yellow.size() >= 2) && (blue.size() >= 2))
+    {
+        angleOfRoad = (reference::angleOfRoad(yellow, sort) + reference::angleOfRoad(blue, sort)) / 2;
+    }
+    else if (yellow.size() >= 2)
+    {
+        angleOfRoad = reference::angleOfRoad(yellow, sort);
+    }
+    else if (blue.size() >= 2)
+    {
+        angleOfRoad = reference::angleOfRoad(blue, sort);
+    }
+    return ((angleOfRoad < 90) || (angleOfRoad > 90)) ? (angleOfRoad * 0.003333) - 0.3 : 0.0;
+}
+} // namespace reference
+
+// Compares both implementations on one set of cones and counts the failures.
+class Checker
+{
+  public:
+    void check(const char *name, const std::vector<cv::Point2f> &yellow, const std::vector<cv::Point2f> &blue, const reference::Sort &sort = reference::sortByHeight)
+    {
+        const uint64_t allocationsBefore{allocationCount()};
+        const double angle{steeringAngle(yellow.data(), yellow.size(), blue.data(), blue.size())};
+        const double road{(2 <= yellow.size()) ? angleOfRoad(yellow.data(), yellow.size()) : 90.0};
+        const uint64_t allocations{allocationCount() - allocationsBefore};
+
+        const double expectedAngle{reference::steeringAngle(yellow, blue, sort)};
+        const double expectedRoad{(2 <= yellow.size()) ? reference::angleOfRoad(yellow, sort) : 90.0};
+
+        m_cases++;
+        if ((0 != std::memcmp(&angle, &expectedAngle, sizeof(angle))) || (0 != std::memcmp(&road, &expectedRoad, sizeof(road))))
+        {
+            fail(name, "steering " + std::to_string(angle) + " (road " + std::to_string(road) + "), expected " + std::to_string(expectedAngle) + " (road " + std::to_string(expectedRoad) + ")", yellow, blue);
+        }
+        if (0 < allocations)
+        {
+            fail(name, std::to_string(allocations) + " heap allocations", yellow, blue);
+        }
+        if ((expectedAngle < 0.0) || (expectedAngle > 0.0))
+        {
+            m_turning++;
+        }
+    }
+
+    uint64_t cases() const { return m_cases; }
+    uint64_t turning() const { return m_turning; }
+    uint64_t failures() const { return m_failures; }
+
+  private:
+    void fail(const char *name, const std::string &what, const std::vector<cv::Point2f> &yellow, const std::vector<cv::Point2f> &blue)
+    {
+        if (m_failures++ < 10)
+        {
+            std::cerr << name << ": " << what << " for " << yellow.size() << " yellow and " << blue.size() << " blue cones";
+            if (!yellow.empty())
+            {
+                std::cerr << ", first yellow (" << yellow[0].x << ", " << yellow[0].y << ")";
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+  private:
+    uint64_t m_cases{0};
+    uint64_t m_turning{0};
+    uint64_t m_failures{0};
+};
+
+int32_t main(int32_t, char **argv)
+{
+    Checker checker;
+    std::mt19937 rng{5};
+    std::vector<cv::Point2f> yellow;
+    std::vector<cv::Point2f> blue;
+    yellow.reserve(64);
+    blue.reserve(64);
+
+    // Random cones in the lower half of the view, with real and with integer coordinates
+    for (uint32_t i = 0; i < 200000; i++)
+    {
+        const bool grid{0 == i % 3};
+        auto cone = [&rng, grid]() {
+            return grid ? cv::Point2f(static_cast<float>(rng() % 640), static_cast<float>(250 + rng() % 240))
+                        : cv::Point2f(static_cast<float>(rng() % 64000) / 100.0f, static_cast<float>(rng() % 48000) / 100.0f + 100.0f);
+        };
+        yellow.resize(rng() % ((0 == i % 7) ? 16 : 12));
+        blue.resize(rng() % 12);
+        std::generate(yellow.begin(), yellow.end(), cone);
+        std::generate(blue.begin(), blue.end(), cone);
+        checker.check("random", yellow, blue);
+    }
+
+    // Cones at the same height keep their order; beyond 16 cones std::sort does not guarantee that,
+    // so the original is taken with a stable sort there
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        const std::size_t count{2 + rng() % 40};
+        yellow.resize(count);
+        for (cv::Point2f &cone : yellow)
+        {
+            cone = cv::Point2f(static_cast<float>(200 + rng() % 240), static_cast<float>(400 + rng() % 4 * 20));
+        }
+        blue.clear();
+        checker.check("ties", yellow, blue, (16 < count) ? reference::Sort{reference::stableSortByHeight} : reference::Sort{reference::sortByHeight});
+    }
+
+    // The nearest cone on every integer position within 198 to 202 pixels of the car, where the
+    // squared distance decides instead of the square root
+    for (int32_t dy = -202; dy <= 0; dy++)
+    {
+        for (int32_t dx = -202; dx <= 202; dx++)
+        {
+            const int32_t squared{dx * dx + dy * dy};
+            if ((squared < 198 * 198) || (squared > 202 * 202))
+            {
+                continue;
+            }
+            const cv::Point2f nearest(static_cast<float>(X_POSITION_OF_CAR + dx), static_cast<float>(Y_POSITION_OF_CAR + dy));
+            yellow.assign({nearest, cv::Point2f(nearest.x + 37.0f, nearest.y - 11.0f)});
+            blue.assign({cv::Point2f(nearest.x - 5.0f, nearest.y - 30.0f), nearest});
+            checker.check("200 pixels", yellow, blue);
+        }
+    }
+
+    // The next cone around the nearest one in steps of a hundredth of a degree across the edges of
+    // the dead zone at 60 and 120 degrees
+    for (double edge : {60.0, 120.0})
+    {
+        for (int32_t step = -300; step <= 300; step++)
+        {
+            const double radians{(180.0 - edge + step * 0.01) * PI / 180.0};
+            const cv::Point2f nearest(300.0f, 420.0f);
+            const cv::Point2f next(static_cast<float>(nearest.x - 50.0 * std::cos(radians)), static_cast<float>(nearest.y - 50.0 * std::sin(radians)));
+            yellow.assign({next, nearest});
+            blue.clear();
+            checker.check("dead zone", yellow, blue);
+        }
+
+        // And float by float around the position of the next cone where the original crosses the edge
+        const cv::Point2f nearest(300.0f, 420.0f);
+        float inside{nearest.x};
+        float outside{(edge < 90.0) ? nearest.x + 200.0f : nearest.x - 200.0f};
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            const float middle{inside + (outside - inside) / 2.0f};
+            yellow.assign({cv::Point2f(middle, 370.0f), nearest});
+            const double road{reference::angleOfRoad(yellow, reference::sortByHeight)};
+            ((road >= 90.0) && (road <= 90.0) ? inside : outside) = middle;
+        }
+        float x{inside};
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            x = std::nextafter(x, outside);
+            yellow.assign({cv::Point2f(x, 370.0f), nearest});
+            checker.check("dead zone edge", yellow, blue);
+        }
+    }
+
+    std::clog << argv[0] << ": " << checker.cases() << " cone sets (" << checker.turning() << " turning), " << checker.failures() << " failures." << std::endl;
+    return (0 == checker.failures()) ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021  2021-group-10
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small pool of persistent threads that run a batch of independent tasks
+// together with the calling thread. Threads are started once, so a batch
+// costs a wake-up instead of a thread start; workers spin briefly before they
+// sleep to catch batches that follow each other closely. A pool without
+// workers runs every task on the calling thread. Nothing is allocated per
+// batch.
+class WorkerPool
+{
+  public:
+    explicit WorkerPool(uint32_t workers)
+    {
+        for (uint32_t i = 0; i < workers; i++)
+        {
+            m_threads.emplace_back(&WorkerPool::work, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_all();
+        for (std::thread &thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Number of threads that take part in a batch, including the caller.
+    uint32_t concurrency() const { return static_cast<uint32_t>(m_threads.size()) + 1; }
+
+    // Calls task(i) for every i in [0, count) and returns when all calls are
+    // done. Must not be called from two threads at the same time.
+    template <typename Task>
+    void run(uint32_t count, const Task &task)
+    {
+        dispatch(count, &task, [](const void *t, uint32_t i) { (*static_cast<const Task *>(t))(i); });
+    }
+
+  private:
+    using Trampoline = void (*)(const void *, uint32_t);
+
+    void dispatch(uint32_t count, const void *task, Trampoline trampoline)
+    {
+        if (m_threads.empty() || (count < 2))
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                trampoline(task, i);
+            }
+            return;
+        }
+
+        m_task = task;
+        m_trampoline = trampoline;
+        m_count = count;
+        m_next.store(0);
+        m_busyWorkers.store(static_cast<uint32_t>(m_threads.size()));
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            m_generation.fetch_add(1);
+        }
+        m_wakeUp.notify_all();
+
+        drain();
+
+        // Wait until every worker is done with this batch so none of them can
+        // pick up an index of the next one.
+        while (0 != m_busyWorkers.load())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void drain()
+    {
+        for (uint32_t i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1))
+        {
+            m_trampoline(m_task, i);
+        }
+    }
+
+    void work()
+    {
+        uint64_t seen{0};
+        while (true)
+        {
+            for (uint32_t spin = 0; (spin < SPIN) && (seen == m_generation.load()); spin++)
+            {
+            }
+            if (seen == m_generation.load())
+            {
+                std::unique_lock<std::mutex> lck(m_mutex);
+                m_wakeUp.wait(lck, [this, seen]() { return m_stopping || (seen != m_generation.load()); });
+                if (m_stopping)
+                {
+                    return;
+                }
+            }
+            seen = m_generation.load();
+            drain();
+            m_busyWorkers.fetch_sub(1);
+        }
+    }
+
+  private:
+    static constexpr uint32_t SPIN = 20000;
+
+    std::vector<std::thread> m_threads{};
+    std::mutex m_mutex{};
+    std::condition_variable m_wakeUp{};
+    bool m_stopping{false};
+    std::atomic<uint64_t> m_generation{0};
+    const void *m_task{nullptr};
+    Trampoline m_trampoline{nullptr};
+    uint32_t m_count{0};
+    std::atomic<uint32_t> m_next{0};
+    std::atomic<uint32_t> m_busyWorkers{0};
+};
+
+#endif